@@ -0,0 +1,71 @@
+/*
+Runtime for ROMs compiled ahead of time by the VChip8Aot tool.
+    1. The tool follows the control flow of a ROM from 0x200 and emits a C++ translation unit with one
+       native function per basic block, operating directly on a VChip8.
+    2. The translation unit registers its program at startup, VChip8AotRunner picks the program whose
+       ROM image matches what is loaded and runs its blocks instead of the interpreter.
+    3. Addresses no block starts at (targets of Bnnn computed jumps, code the analysis did not reach)
+       and blocks whose bytes were rewritten at run time (self-modifying code) are interpreted.
+*/
+
+#ifndef __V_CHIP_8_AOT__
+#define __V_CHIP_8_AOT__
+
+#include "chip_8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//a compiled basic block covering the bytes [start, end)
+struct VChip8AotBlock{
+    uint16_t start;
+    uint16_t end;
+    uint16_t length;        //instructions in the block
+    //executes the whole block and leaves the program counter at its successor
+    void (*code)(VChip8&);
+};
+
+struct VChip8AotProgram{
+    const char* name;
+    const uint8_t* rom;     //ROM image the blocks were compiled from, loaded at 0x200
+    size_t rom_size;
+    const VChip8AotBlock* blocks;
+    size_t block_count;
+};
+
+//called from the generated translation units, before main
+void vchip8_aot_register(const VChip8AotProgram*);
+
+class VChip8AotRunner{
+    public:
+        //uses the registered program matching the ROM in memory, if there is one
+        explicit VChip8AotRunner(VChip8&);
+        VChip8AotRunner(VChip8&, const VChip8AotProgram&);
+
+        VChip8AotRunner(const VChip8AotRunner&) = delete;
+        VChip8AotRunner& operator=(const VChip8AotRunner&) = delete;
+
+        //the program in use, nullptr if the ROM was not compiled and run() only interprets
+        const VChip8AotProgram* program() const;
+
+        //same contract as VChip8::run
+        unsigned int run(unsigned int);
+
+        //same contract as VChip8::run_frame
+        unsigned int run_frame(unsigned int);
+
+        //programs compiled into this binary
+        static const std::vector<const VChip8AotProgram*>& registered();
+
+    private:
+        VChip8& chip8;
+        const VChip8AotProgram* compiled;
+        std::vector<const VChip8AotBlock*> entries; //block starting at each address
+        uint32_t verified_generation[0x1000 / 256];  //page generations when memory matched the ROM
+        uint32_t mismatched_generation[0x1000 / 256]; //page generations when it didn't, not compared again
+
+        void attach(const VChip8AotProgram*);
+        bool intact(const VChip8AotBlock&);
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+Audio output driven by the sound timer.
+    1. After every 60Hz frame the emulation thread pushes the frame's sound state (timer running,
+       16-byte 1-bit pattern and pitch) into a VChip8AudioRing, a fixed-size single-producer/single-consumer
+       ring of atomics. A full ring drops the frame, the emulation never waits for audio.
+    2. VChip8AudioSynth runs on the audio thread, pops one frame per 1/60s worth of samples and plays its
+       pattern as 1-bit PCM at 4000 * 2^((pitch - 64) / 48) bits per second. It never locks or allocates.
+       CHIP-8 and SUPER-CHIP ROMs play a fixed square wave, XO-CHIP ROMs their F002 pattern and Fx3A pitch.
+    3. The synth holds the previous frame for a few frames when the ring runs dry and skips frames when it
+       fills up, so emulation jitter neither clicks nor builds up latency.
+    4. VChip8WavFile streams the samples to a 16-bit mono WAV file for headless runs.
+*/
+
+#ifndef __V_CHIP_8_AUDIO__
+#define __V_CHIP_8_AUDIO__
+
+#include "chip_8.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+
+struct VChip8AudioFrame{
+    uint8_t pattern[16];   //128 1-bit samples, most significant bit first
+    uint8_t pitch;
+    uint8_t active;        //sound timer was running at the end of the frame
+
+    //sound state of a machine, taken after run_frame
+    static VChip8AudioFrame capture(const VChip8Machine&);
+};
+
+class VChip8AudioRing{
+    public:
+        static const uint32_t CAPACITY = 16;    //power of two
+
+        //producer side, returns false (dropping the frame) if the ring is full
+        bool push(const VChip8AudioFrame&);
+        //consumer side, returns false if the ring is empty
+        bool pop(VChip8AudioFrame&);
+        //frames queued, exact on the consumer side
+        uint32_t size() const;
+
+    private:
+        //free-running counters on separate cache lines, written only by their own side
+        alignas(64) std::atomic<uint32_t> head{0};  //next frame to pop
+        alignas(64) std::atomic<uint32_t> tail{0};  //next slot to push
+        alignas(64) VChip8AudioFrame frames[CAPACITY];
+};
+
+class VChip8AudioSynth{
+    public:
+        VChip8AudioSynth(VChip8AudioRing&, unsigned int sample_rate = 44100, int16_t amplitude = 8000);
+
+        //fills the buffer with mono samples, consuming a frame from the ring every 1/60s of output
+        void render(int16_t*, size_t);
+
+        //pops the next frame and renders exactly its samples, returns the count (at most max_frame_samples());
+        //headless runs push one frame and render it so the output doesn't depend on timing
+        size_t render_frame(int16_t*);
+
+        size_t max_frame_samples() const;
+        unsigned int get_sample_rate() const;
+
+    private:
+        static const uint32_t MAX_QUEUED = 3;   //frames of latency before the synth skips ahead
+        static const unsigned int MAX_HOLD = 3; //frames an underrun keeps playing before going silent
+
+        VChip8AudioRing& ring;
+        unsigned int sample_rate;
+        int16_t amplitude;
+
+        VChip8AudioFrame current{};
+        size_t samples_left = 0;        //samples of the current frame still to render
+        unsigned int rate_remainder = 0;//sample_rate / 60 remainder carried between frames
+        unsigned int held = 0;          //frames repeated since the ring last had one
+        uint64_t phase = 0;             //position in the pattern, 32.32 fixed point bits
+        uint64_t step = 0;              //phase advance per sample
+
+        void next_frame();
+        void synthesize(int16_t*, size_t);
+};
+
+class VChip8WavFile{
+    public:
+        ~VChip8WavFile();
+
+        //writes a 16-bit mono header, the sizes are filled in by close()
+        bool open(const char*, unsigned int sample_rate);
+        void write(const int16_t*, size_t);
+        bool close();
+
+    private:
+        std::ofstream file;
+        uint64_t data_bytes = 0;
+};
+
+#endif
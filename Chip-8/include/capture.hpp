@@ -0,0 +1,116 @@
+/*
+Streaming capture of emulated frames to video files, pipes or image sequences, without a display.
+    1. submit() copies the packed planes of a frame (see VChip8Frame) into a fixed ring and returns;
+       expanding, scaling and encoding run on the sink's own thread. A frame identical to the one
+       submitted before it is not expanded or encoded again: streams write the previous frame's bytes
+       once more, so they keep 60 frames per second and stay in sync with the sound, and image
+       sequences, which are numbered by frame, skip it.
+    2. A full ring drops the frame (counted in dropped()) so capture never holds up emulation, unless
+       the sink was opened with block_when_full, which headless runs use to keep every frame.
+    3. Outputs have a fixed size: 64x32 for CHIP-8, 128x64 for the other modes (lo-res frames are
+       doubled), times the scaler's factor. Alpha is always opaque.
+        raw  RGBA bytes, frame after frame
+        y4m  YUV4MPEG2, 4:4:4 at 60 frames per second (BT.601 limited range)
+        png  one file per frame, the path is a printf pattern taking the frame number, e.g. shots/%06u.png;
+             the images are stored uncompressed, so no zlib is needed
+    Paths of raw and y4m streams may be "-" for standard output.
+*/
+
+#ifndef __V_CHIP_8_CAPTURE__
+#define __V_CHIP_8_CAPTURE__
+
+#include "chip_8.hpp"
+#include "exchange.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+class VChip8Capture{
+    public:
+        enum Format:uint8_t{ FORMAT_RAW, FORMAT_Y4M, FORMAT_PNG };
+        enum Scaler:uint8_t{ SCALER_NEAREST, SCALER_EPX, SCALER_SCANLINES };
+
+        struct Options{
+            Format format = FORMAT_Y4M;
+            Scaler scaler = SCALER_NEAREST;
+            unsigned int factor = 1;        //EPX is always 2
+            bool dedupe = true;             //repeat (streams) or skip (PNG) frames identical to the previous one
+            bool block_when_full = false;   //wait for the encoder instead of dropping frames
+            VChip8::Mode mode = VChip8::MODE_CHIP8;
+        };
+
+        VChip8Capture() = default;
+        VChip8Capture(const VChip8Capture&) = delete;
+        VChip8Capture& operator=(const VChip8Capture&) = delete;
+        ~VChip8Capture();
+
+        //opens the output and starts the encoder thread
+        bool open(const char*, const Options&);
+
+        //queues the current display of the machine, call from one thread only
+        void submit(const VChip8Machine&, uint64_t frame_number);
+
+        //encodes what is still queued, stops the thread and closes the output, false if a write failed
+        bool close();
+
+        //"raw", "y4m" or "png"
+        static bool parse_format(const char*, Format&);
+        //png for .png, raw for .raw and .rgba, y4m for anything else
+        static Format format_for(const char*);
+        //"nearest:N", "epx" or "scanlines:N"
+        static bool parse_scaler(const char*, Scaler&, unsigned int&);
+
+        unsigned int output_width() const;
+        unsigned int output_height() const;
+
+        uint64_t written() const;
+        uint64_t duplicates() const;
+        uint64_t dropped() const;
+
+    private:
+        static const uint32_t CAPACITY = 64;
+
+        Options options;
+        std::string path;
+        FILE* output = nullptr;
+        bool running = false;
+        unsigned int base_width = 0, base_height = 0;
+
+        //a queued frame, or a repeat of the previous one whose frame is not filled in
+        struct Entry{
+            VChip8Frame frame;
+            bool repeat;
+        };
+
+        //single-producer/single-consumer ring, same layout as VChip8AudioRing
+        alignas(64) std::atomic<uint32_t> head{0};
+        alignas(64) std::atomic<uint32_t> tail{0};
+        std::vector<Entry> queue;
+        std::atomic<bool> closing{false};
+        std::thread worker;
+
+        //producer side
+        VChip8Frame last{};
+        bool has_last = false;
+        uint64_t duplicate_count = 0;
+        uint64_t dropped_count = 0;
+
+        //consumer side
+        std::atomic<uint64_t> written_count{0};
+        bool failed = false;
+        std::vector<uint32_t> base, scaled, lores;
+        std::vector<uint8_t> bytes;
+
+        void run();
+        bool enqueue(const VChip8Frame*);
+        void encode(const VChip8Frame&);
+        void repeat();
+        void write_raw();
+        void write_y4m();
+        bool write_png(uint64_t);
+};
+
+#endif
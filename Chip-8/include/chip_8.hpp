@@ -3,9 +3,9 @@ A simple implementation of Chip-8 emulator.
 Componenets:
     1. Register: 16 8-bit registers, Labeled from V0 till VF.
     2. Special Register: VF (flag register)
-    3. Memory(4K Bytes), address space -> 0x000 till 0xFFF
+    3. Memory(4K Bytes), address space -> 0x000 till 0xFFF (64K Bytes, 0x0000 till 0xFFFF for XO-CHIP)
     4. RESERVED_MEM: 0x000 -  0x1FF (interpreter)
-    5. FONT_MEM: 0x050 - 0x0A0 for storing characters
+    5. FONT_MEM: 0x050 - 0x0A0 for storing characters, BIG_FONT_MEM: 0x0A0 - 0x140 for the 8x10 SUPER-CHIP digits
     6. ROM_MEM: 0x200 - 0xFFF for ROM and program usage
     7. 16-bit Index register [indexing memory]
     8. 16-bit Program Counter [Count of next instruction to be fetched]
@@ -25,9 +25,32 @@ Componenets:
             |A|0|B|F|               |Z|X|C|V|
             +-+-+-+-+               +-+-+-+-+  
     14. 64x32 Monochrome Display Memory: Each pixel/memory location is either 0 or 1, total space is 2048 or 2K bits
+            stored as 32 rows of 64 bits, the most significant bit of a row is its leftmost pixel
             PixelOnSprite XOR PixelInMemory = Pixel in Memory on or off
             to move something already drawn, first we again issue the command to draw at that same location (this removes the drawn object)
             and then issue another draw command at the new location.               
+    15. Modes (set_mode, before loadRom): CHIP-8 (the default) as described above, SUPER-CHIP adds the 128x64
+        hi-res display, 16x16 sprites, scrolling, the big font and the flag registers, XO-CHIP adds a second
+        display plane, 64K of memory, F000 nnnn long loads, 5xy2/5xy3 register ranges and the audio pattern.
+        Scrolling and the hi-res display follow the modern (Octo) behaviour: scroll distances are in pixels
+        of the current resolution, switching resolution clears the display and VF is 0/1 in every mode.
+    16. Quirks: the machine is a template, VChip8Core<Quirks, Bounds>, and the behaviours that differ between
+        interpreters are compile-time constants of the Quirks policy, so a profile pays nothing for the quirks
+        it doesn't use. VChip8Quirks is the behaviour this emulator always had, the other profiles change
+        some of its members:
+            shift_vy          8xy6/8xyE shift Vy into Vx instead of shifting Vx
+            load_store_index  Fx55/Fx65 leave I past the last register instead of unchanged
+            jump_vx           Bnnn jumps to xnn + Vx instead of nnn + V0
+            wrap_sprites      sprites wrap around the edges of the display instead of being clipped
+            logic_vf_reset    8xy1/8xy2/8xy3 clear VF
+        VChip8QuirksVip (COSMAC VIP), VChip8QuirksSchip (SUPER-CHIP 1.1) and VChip8QuirksOcto (Octo) are
+        provided, VChip8 is VChip8Core<VChip8Quirks, VChip8BoundsMasked>.
+    17. Bounds: VChip8BoundsMasked wraps every memory address at the end of memory and the stack index
+        at 16 entries, without a branch. VChip8BoundsChecked stops the machine instead, on the faulting
+        instruction, with STACK_OVERFLOW (2nnn on a full stack), STACK_UNDERFLOW (00EE on an empty one)
+        or MEMORY_OUT_OF_BOUNDS (an instruction reading or writing memory past the end from I).
+        Every combination of the four quirk profiles and two bounds policies is compiled into the core
+        library, the JIT, AOT and lockstep engines only run VChip8.
 */
 
 #ifndef __V_CHIP_8__
@@ -38,6 +61,11 @@ Componenets:
 #include <chrono>
 #include <string>
 #include <random>
+#include <vector>
+#include <type_traits>
+#ifdef VCHIP8_PROFILE
+#include <ostream>
+#endif
 
 
 
@@ -47,65 +75,229 @@ Componenets:
 #define OP_LAST_BYTE(opcode) (opcode & 0x00FFu)
 
 
-class  VChip8{
+//quirk profiles, see point 16
+struct VChip8Quirks{
+    static constexpr bool shift_vy = false;
+    static constexpr bool load_store_index = false;
+    static constexpr bool jump_vx = false;
+    static constexpr bool wrap_sprites = false;
+    static constexpr bool logic_vf_reset = false;
+};
+
+//the original COSMAC VIP interpreter
+struct VChip8QuirksVip : VChip8Quirks{
+    static constexpr bool shift_vy = true;
+    static constexpr bool load_store_index = true;
+    static constexpr bool logic_vf_reset = true;
+};
+
+//SUPER-CHIP 1.1 on the HP 48
+struct VChip8QuirksSchip : VChip8Quirks{
+    static constexpr bool jump_vx = true;
+};
+
+//Octo, the reference for XO-CHIP
+struct VChip8QuirksOcto : VChip8Quirks{
+    static constexpr bool shift_vy = true;
+    static constexpr bool load_store_index = true;
+    static constexpr bool wrap_sprites = true;
+};
+
+//bounds policies, see point 17
+struct VChip8BoundsMasked{
+    static constexpr bool checked = false;
+};
+
+struct VChip8BoundsChecked{
+    static constexpr bool checked = true;
+};
+
+//machine state and everything that doesn't depend on the quirks: decoding, the instruction cache,
+//modes, save states, hashes; the instructions themselves are in VChip8Core below
+class  VChip8Machine{
     public:
          //error codes:
         enum ErrorCodes:char{
                 ALL_OKAY = 0,
                 FILE_NOT_FOUND,
                 UNDEFINED_INSTR,
-                ROM_OVERFLOW
+                ROM_OVERFLOW,
+                PROGRAM_EXITED,     //00FD, SUPER-CHIP's exit
+                STACK_OVERFLOW,     //VChip8BoundsChecked only, see point 17
+                STACK_UNDERFLOW,
+                MEMORY_OUT_OF_BOUNDS
                  //rest of the code if any
         } ;
 
-    private:
+        //handler ids, one per leaf instruction, used to index the handler table
+        enum InstrId:uint8_t{
+                ID_NULL = 0,
+                ID_00E0, ID_00EE, ID_1nnn, ID_2nnn, ID_3xkk, ID_4xkk, ID_5xy0,
+                ID_6xkk, ID_7xkk, ID_8xy0, ID_8xy1, ID_8xy2, ID_8xy3, ID_8xy4,
+                ID_8xy5, ID_8xy6, ID_8xy7, ID_8xyE, ID_9xy0, ID_Annn, ID_Bnnn,
+                ID_Cxkk, ID_Dxyn, ID_Ex9E, ID_ExA1, ID_Fx07, ID_Fx0A, ID_Fx15,
+                ID_Fx18, ID_Fx1E, ID_Fx29, ID_Fx33, ID_Fx55, ID_Fx65,
+                //SUPER-CHIP and XO-CHIP, only decoded in their modes
+                ID_00Cn, ID_00Dn, ID_00FB, ID_00FC, ID_00FD, ID_00FE, ID_00FF,
+                ID_5xy2, ID_5xy3, ID_F000, ID_Fn01, ID_F002, ID_Fx30, ID_Fx3A,
+                ID_Fx75, ID_Fx85,
+                ID_COUNT
+        };
+
+        //instruction set, see point 15 above
+        enum Mode:uint8_t{
+                MODE_CHIP8 = 0,
+                MODE_SCHIP,
+                MODE_XOCHIP,
+                MODE_COUNT
+        };
+
+        //a decoded instruction, operands are extracted once at decode time
+        struct Instruction{
+            uint8_t id;      //InstrId of the leaf handler
+            uint8_t x;       //Vx register index
+            uint8_t y;       //Vy register index
+            uint8_t kk;      //lowest byte
+            uint16_t nnn;    //lowest 12 bits (address)
+            uint8_t n;       //lowest nibble
+            uint8_t length;  //instructions left in the basic block starting here, 0 if not decoded
+        };
+
+        //complete machine state for save states and rewind (the keypad belongs to the host and is
+        //not included), a flat block of bytes without padding so snapshots can be hashed and diffed,
+        //the random engine is stored as its raw bytes so the layout does not depend on the library
+        struct Snapshot{
+            uint8_t memory[0x10000];
+            uint64_t video_memory[2 * 128];
+            uint16_t stack[16];
+            uint8_t registers[16];
+            uint8_t flag_registers[16];
+            uint8_t audio_pattern[16];
+            uint16_t index_register;
+            uint16_t program_counter;
+            uint8_t stack_pointer;
+            uint8_t delay_timer;
+            uint8_t sound_timer;
+            uint8_t error_code;
+            uint8_t mode;
+            uint8_t hires;
+            uint8_t plane_mask;
+            uint8_t pitch;
+            uint8_t halted;
+            uint8_t reserved[3];
+            uint8_t random_engine[8];
+        };
+        static_assert(sizeof(Snapshot) == 0x10000 + 2 * 128 * 8 + 16 * 2 + 3 * 16 + 2 * 2 + 9 + 3 + 8,
+                      "Snapshot must not contain padding");
+        static_assert(sizeof(std::default_random_engine) <= sizeof(Snapshot::random_engine) &&
+                      std::is_trivially_copyable<std::default_random_engine>::value,
+                      "the random engine must fit the snapshot as raw bytes");
+
+    protected:
     
-        const int ROM_MEM = 0x200;
-        const int FONT_MEM = 0x050;
-        const unsigned int FONT_SET_SIZE  = 80;
-        const unsigned int VIDEO_WIDTH = 64;
-        const unsigned int VIDEO_HEIGHT = 32;
+        static constexpr int ROM_MEM = 0x200;
+        static constexpr int FONT_MEM = 0x050;
+        static constexpr unsigned int FONT_SET_SIZE  = 80;
+        static constexpr unsigned int VIDEO_WIDTH = 64;
+        static constexpr unsigned int VIDEO_HEIGHT = 32;
+        static constexpr unsigned int HIRES_WIDTH = 128;
+        static constexpr unsigned int HIRES_HEIGHT = 64;
+        static constexpr int BIG_FONT_MEM = 0x0A0;
+        static constexpr unsigned int BIG_FONT_SET_SIZE = 160;
+        static constexpr unsigned int MEMORY_SIZE = 0x10000;
+
+        //decoded instruction cache, one entry per byte address in ROM_MEM..0xFFF
+        static const unsigned int CACHE_SIZE = 0x1000 - 0x200;
+        //upper bound of a basic block, keeps invalidation windows small
+        static const unsigned int MAX_BLOCK_LENGTH = 32;
 
         ErrorCodes error_code;
+        Mode mode = MODE_CHIP8;
+        uint16_t address_mask = 0xFFFu; //memory wraps at 4K outside XO-CHIP
+
+        Instruction icache[CACHE_SIZE]{};
+        uint64_t code_map[0x1000 / 64]{}; //one bit per memory byte covered by a decoded instruction
+        Instruction uncached{}; //scratch entry for code running outside the cache
         
         void loadFontSet();
 
+        void decode_block(uint16_t);
+        const Instruction& fetch(uint16_t);
+
+        //bumps generations and drops decodes for a write of size bytes at address, wrapping at the end of memory
+        void invalidate_written(unsigned int, unsigned int);
+
+        //skip instructions jump over the whole 4-byte F000 nnnn in XO-CHIP
+        void skip(){
+            if (this->mode == MODE_XOCHIP && this->memory[this->program_counter] == 0xF0u &&
+                this->memory[(uint16_t)(this->program_counter + 1)] == 0x00u)
+                this->program_counter += 4;
+            else
+                this->program_counter += 2;
+        }
 
     public:
         uint8_t  registers[16]{};
-        uint8_t  memory[4096]{}; //each memory location is 8 bit --> 1 Byte * 4096
+        uint8_t  memory[MEMORY_SIZE]{}; //each memory location is 8 bit, only the first 4K are used outside XO-CHIP
         uint8_t  keypad[16]{}; //for storing which key was pressed 
         uint16_t stack[16]{}; //16 level stack with each entry of 16 bits to store memory address
-        uint32_t video_memory[2048]{}; //for compatibility with SDL using uint32_t
+        //display planes of PLANE_WORDS words each, one bit per pixel with the most significant bit leftmost;
+        //a lo-res row is one word (64 pixels), a hi-res row two words (128 pixels), see video.hpp for RGBA expansion
+        static constexpr unsigned int VIDEO_PLANES = 2;
+        static constexpr unsigned int PLANE_WORDS = 128;
+        uint64_t video_memory[VIDEO_PLANES * PLANE_WORDS]{};
+        bool hires = false;         //128x64 instead of 64x32, SUPER-CHIP and XO-CHIP
+        uint8_t plane_mask = 1;     //planes drawn, cleared and scrolled, set by XO-CHIP's Fn01
 
+        uint8_t flag_registers[16]{};   //Fx75/Fx85 storage, survives reset()
+        uint8_t audio_pattern[16]{};    //XO-CHIP 1-bit sample loop, set by F002
+        uint8_t pitch = 64;             //XO-CHIP playback rate, 4000 * 2^((pitch - 64) / 48) Hz
 
-        using Chip8Func = void (VChip8::*) (); //function pointer
-        
-        Chip8Func table[0xF + 1];
-        Chip8Func table0[0xE + 1];
-        Chip8Func table8[0xE + 1];
-        Chip8Func tableE[0xE + 1];
-        Chip8Func tableF[0x65 + 1];
-
-        uint8_t font_set[80] = {
-            //every 1 is a pixel active and 0 is pixel off
-	            0xF0, 0x90, 0x90, 0x90, 0xF0, // 0 
-	            0x20, 0x60, 0x20, 0x20, 0x70, // 1
-	            0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-	            0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-	            0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-	            0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-	            0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-	            0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-	            0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-	            0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-	            0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-	            0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-	            0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-	            0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-	            0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-	            0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-        }; //font set for storing 16 characters each of 5 * 8 bits
+        //set by 00E0/Dxyn and the scroll and resolution instructions, rows [dirty_top, dirty_bottom)
+        //of the current resolution changed since the last take_dirty_rows()
+        //starts out set so the first presented frame covers the whole display
+        bool draw_flag = true;
+        uint8_t dirty_top = 0;
+        uint8_t dirty_bottom = 32;
+
+        //set when Fx0A finds no key down; the program counter stays on the Fx0A and run() returns
+        //without executing anything until a key is pressed, so schedulers (see runner.hpp) can park
+        //the machine and only tick its timers
+        bool halted = false;
+
+        //lets run() count the passes of a loop that only reads state instead of executing them,
+        //see VChip8Core::idle_loop; the results are the same, clear it to measure the difference
+        bool skip_idle_loops = true;
+
+        //undefined opcodes run as no-ops instead of stopping the machine with UNDEFINED_INSTR, and the
+        //addresses of the first MAX_UNDEFINED distinct ones are kept in undefined_addresses, and
+        //undefined_overflow is set once another one had to be dropped; for compatibility runs that
+        //report every undefined opcode of a ROM (see compat.cpp)
+        static constexpr size_t MAX_UNDEFINED = 64;
+        bool skip_undefined = false;
+        std::vector<uint16_t> undefined_addresses;
+        bool undefined_overflow = false;
+
+        //opcode pattern of every InstrId ("8xy4"), for reports
+        static const char* const instr_names[ID_COUNT];
+
+        //decode tables, opcode nibble/byte -> InstrId, built at compile time and shared by all instances
+        //groups 0, 5, 8, E and F are resolved through their own sub-table, one set per Mode
+        struct DecodeTables{
+            uint8_t table[0xF + 1];
+            uint8_t table0[0xFF + 1];   //by the low byte
+            uint8_t table5[0xF + 1];
+            uint8_t table8[0xF + 1];
+            uint8_t tableE[0xF + 1];
+            uint8_t tableF[0xFF + 1];   //by the low byte
+            bool strict0;               //group 0 needs x = 0, CHIP-8 decodes 0nnn by its last nibble only
+        };
+        static const DecodeTables decode_tables[MODE_COUNT];
+
+        //font set for storing 16 characters each of 5 * 8 bits, copied to FONT_MEM
+        static const uint8_t font_set[80];
+        //16 characters of 8 * 10 bits for Fx30, copied to BIG_FONT_MEM outside CHIP-8 mode
+        static const uint8_t big_font_set[160];
 
         uint16_t index_register{};
         uint16_t program_counter{};
@@ -114,89 +306,250 @@ class  VChip8{
         uint8_t delay_timer{};
         uint8_t sound_timer{};
         uint8_t keypad_mapping[16]{};
-        uint16_t opcode;
+
+        //bumped whenever a 256-byte memory page may have been rewritten, lets
+        //translators outside the core (see jit.hpp) revalidate their code
+        uint32_t page_generation[0x1000 / 256]{};
 
         std::default_random_engine randGen;
         std::uniform_int_distribution<uint8_t> randByte;
 
-        VChip8();
+        VChip8Machine(); //random numbers seeded from the clock
+        explicit VChip8Machine(uint32_t); //random numbers from the given seed, for reproducible runs
+
+        //back to power-on state with a new seed, reuses the instance instead of constructing another
+        //one; page generations keep counting up so translators (see jit.hpp) drop their code
+        void reset(uint32_t);
+        //switches the instruction set, call before loadRom: the display is cleared, memory past the
+        //mode's size is zeroed and the fonts are reloaded, everything else is kept
+        void set_mode(Mode);
+        Mode get_mode() const{
+            return this->mode;
+        }
+        //"chip8", "schip" or "xochip", returns false for anything else
+        static bool parse_mode(const char*, Mode&);
+
+        unsigned int display_width() const{
+            return this->hires ? HIRES_WIDTH : VIDEO_WIDTH;
+        }
+        unsigned int display_height() const{
+            return this->hires ? HIRES_HEIGHT : VIDEO_HEIGHT;
+        }
+        //addressable memory, 4K except for XO-CHIP's 64K
+        size_t memory_size() const{
+            return (size_t)this->address_mask + 1;
+        }
+
         //functions
+        //reads the file through VChip8RomCache::shared(), see rom_cache.hpp
         void loadRom(const char*);
+        //copies a ROM image to 0x200, e.g. one from VChip8RomCache::open_directory
+        void loadRom(const uint8_t*, size_t);
 
-        //see: http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
-        void OP_00E0(); // - CLS
-        void OP_00EE(); // - RET
-//      void OP_0nnn(); // - SYS addr, not implemented
-        void OP_1nnn(); // - JP addr
-        void OP_2nnn(); // - CALL addr
-        void OP_3xkk(); // - SE Vx, byte
-        void OP_4xkk(); // - SNE Vx, byte
-        void OP_5xy0(); // - SE Vx, Vy
-        void OP_6xkk(); // - LD Vx, byte
-        void OP_7xkk(); // - ADD Vx, byte
-        void OP_8xy0(); // - LD Vx, Vy
-        void OP_8xy1(); // - OR Vx, Vy
-        void OP_8xy2(); // - AND Vx, Vy
-        void OP_8xy3(); // - XOR Vx, Vy
-        void OP_8xy4(); // - ADD Vx, Vy
-        void OP_8xy5(); // - SUB Vx, Vy
-        void OP_8xy6(); // - SHR Vx {, Vy}
-        void OP_8xy7(); // - SUBN Vx, Vy
-        void OP_8xyE(); // - SHL Vx {, Vy}
-        void OP_9xy0(); // - SNE Vx, Vy
-        void OP_Annn(); // - LD I, addr
-        void OP_Bnnn(); // - JP V0, addr
-        void OP_Cxkk(); // - RND Vx, byte
-        void OP_Dxyn(); // - DRW Vx, Vy, nibble
-        void OP_Ex9E(); // - SKP Vx
-        void OP_ExA1(); // - SKNP Vx
-        void OP_Fx07(); // - LD Vx, DT
-        void OP_Fx0A(); // - LD Vx, K
-        void OP_Fx15(); // - LD DT, Vx
-        void OP_Fx18(); // - LD ST, Vx
-        void OP_Fx1E(); // - ADD I, Vx
-        void OP_Fx29(); // - LD F, Vx
-        void OP_Fx33(); // - LD B, Vx
-        void OP_Fx55(); // - LD [I], Vx
-        void OP_Fx65(); // - LD Vx, [I]
-
-        void cycle(); //fetch-decode-execute
+        //decrements the delay and sound timers, call once per 60Hz frame
+        void tick_timers(){
+            // Decrement the delay timer if it's been set
+            if (this->delay_timer > 0)
+                --this->delay_timer;
+
+            // Decrement the sound timer if it's been set
+            if (this->sound_timer > 0)
+                --this->sound_timer;
+        }
+        //the same as calling tick_timers() once for each of the given frames
+        void tick_timers(uint64_t frames){
+            this->delay_timer = this->delay_timer > frames ? (uint8_t)(this->delay_timer - frames) : 0;
+            this->sound_timer = this->sound_timer > frames ? (uint8_t)(this->sound_timer - frames) : 0;
+        }
+
+        //keys held down, bit k for key k
+        uint16_t pressed_keys() const{
+            uint16_t keys = 0;
+            for (unsigned int k = 0; k < 16; k++)
+                keys |= (uint16_t)((this->keypad[k] != 0) << k);
+            return keys;
+        }
+        //false while halted on Fx0A with no key down, otherwise clears the halt and returns true;
+        //the Fx0A is executed again and takes the key
+        bool wake(){
+            if (this->halted && !pressed_keys())
+                return false;
+            this->halted = false;
+            return true;
+        }
+
+        Instruction decode(uint16_t) const;
+
+        //drops cached decodes overlapping [address, address + size), call after writing to memory directly
+        void invalidate_code(uint16_t, uint16_t);
+        void flush_code_cache();
+
+        //grows the dirty row range by [top, bottom) and raises the draw flag
+        void mark_dirty_rows(unsigned int top, unsigned int bottom){
+            if (!this->draw_flag){
+                this->dirty_top = top;
+                this->dirty_bottom = bottom;
+                this->draw_flag = true;
+                return;
+            }
+            if (top < this->dirty_top)
+                this->dirty_top = top;
+            if (bottom > this->dirty_bottom)
+                this->dirty_bottom = bottom;
+        }
+
+        void snapshot(Snapshot&) const;
+        //restores a snapshot, drops decoded code and marks the whole display dirty
+        void restore(const Snapshot&);
 
         int get_error_code();
 
         std::string get_error_name();
-        
-        //tables 
-        // Set up function pointer table
-		
-	void Table0()
-	{
-		((*this).*(table0[opcode & 0x000Fu]))();
-	}
-
-	void Table8()
-	{
-		((*this).*(table8[opcode & 0x000Fu]))();
-	}
-
-	void TableE()
-	{
-		((*this).*(tableE[opcode & 0x000Fu]))();
-	}
-
-	void TableF()
-	{
-		((*this).*(tableF[opcode & 0x00FFu]))();
-	}
-
-	void OP_NULL()
-	{}
 
-        
-        //TODO: Add super chip-8 instructions
+        //returns false if the display is unchanged, otherwise stores the dirty row range
+        //[top, bottom) and clears the draw flag
+        bool take_dirty_rows(unsigned int& top, unsigned int& bottom){
+            if (!this->draw_flag)
+                return false;
+            top = this->dirty_top;
+            bottom = this->dirty_bottom;
+            this->draw_flag = false;
+            return true;
+        }
 
+        uint64_t get_frame_hash(); //FNV-1a hash of the displayed planes, for regression checks
+        uint64_t get_state_hash() const; //FNV-1a hash of the whole snapshot
 
-        
+#ifdef VCHIP8_PROFILE
+        //execution profile, only compiled in with the VCHIP8_PROFILE option, the interpreter
+        //counts every instruction it executes (the JIT is disabled in these builds); addresses
+        //cover the whole 64K so XO-CHIP code above 0xFFF is counted where it runs
+        struct Profile{
+            uint64_t opcode_counts[ID_COUNT];
+            uint64_t pc_counts[0x10000];
+            uint64_t call_counts[0x10000];  //2nnn executions per target
+            uint64_t draw_nanoseconds;      //time spent in OP_Dxyn
+        };
+        Profile profile{};
+
+        void reset_profile();
+
+        //per-opcode and per-address counts plus the OP_Dxyn time as JSON
+        void write_profile_json(std::ostream&) const;
+
+        //collapsed stacks for flamegraph.pl, one "root;subroutine;address opcode count" line per
+        //executed address, addresses are attributed to the closest called address below them
+        void write_profile_collapsed(std::ostream&, const char*) const;
+#endif
+};
+
+//the instructions, with the quirks and bounds checks of the policies compiled in
+template<class Quirks = VChip8Quirks, class Bounds = VChip8BoundsMasked>
+class VChip8Core : public VChip8Machine{
+    public:
+        using VChip8Machine::VChip8Machine;
+
+        using Chip8Func = void (VChip8Core::*) (const Instruction&); //function pointer
+
+        //leaf handlers indexed by InstrId, shared by all instances
+        static const Chip8Func handlers[ID_COUNT];
+
+        //see: http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
+        void OP_00E0(const Instruction&); // - CLS
+        void OP_00EE(const Instruction&); // - RET
+//      void OP_0nnn(const Instruction&); // - SYS addr, not implemented
+        void OP_1nnn(const Instruction&); // - JP addr
+        void OP_2nnn(const Instruction&); // - CALL addr
+        void OP_3xkk(const Instruction&); // - SE Vx, byte
+        void OP_4xkk(const Instruction&); // - SNE Vx, byte
+        void OP_5xy0(const Instruction&); // - SE Vx, Vy
+        void OP_6xkk(const Instruction&); // - LD Vx, byte
+        void OP_7xkk(const Instruction&); // - ADD Vx, byte
+        void OP_8xy0(const Instruction&); // - LD Vx, Vy
+        void OP_8xy1(const Instruction&); // - OR Vx, Vy
+        void OP_8xy2(const Instruction&); // - AND Vx, Vy
+        void OP_8xy3(const Instruction&); // - XOR Vx, Vy
+        void OP_8xy4(const Instruction&); // - ADD Vx, Vy
+        void OP_8xy5(const Instruction&); // - SUB Vx, Vy
+        void OP_8xy6(const Instruction&); // - SHR Vx {, Vy}
+        void OP_8xy7(const Instruction&); // - SUBN Vx, Vy
+        void OP_8xyE(const Instruction&); // - SHL Vx {, Vy}
+        void OP_9xy0(const Instruction&); // - SNE Vx, Vy
+        void OP_Annn(const Instruction&); // - LD I, addr
+        void OP_Bnnn(const Instruction&); // - JP V0, addr
+        void OP_Cxkk(const Instruction&); // - RND Vx, byte
+        void OP_Dxyn(const Instruction&); // - DRW Vx, Vy, nibble
+        void OP_Ex9E(const Instruction&); // - SKP Vx
+        void OP_ExA1(const Instruction&); // - SKNP Vx
+        void OP_Fx07(const Instruction&); // - LD Vx, DT
+        void OP_Fx0A(const Instruction&); // - LD Vx, K
+        void OP_Fx15(const Instruction&); // - LD DT, Vx
+        void OP_Fx18(const Instruction&); // - LD ST, Vx
+        void OP_Fx1E(const Instruction&); // - ADD I, Vx
+        void OP_Fx29(const Instruction&); // - LD F, Vx
+        void OP_Fx33(const Instruction&); // - LD B, Vx
+        void OP_Fx55(const Instruction&); // - LD [I], Vx
+        void OP_Fx65(const Instruction&); // - LD Vx, [I]
+
+        //SUPER-CHIP, see: http://devernay.free.fr/hacks/chip8/schip.txt
+        void OP_00Cn(const Instruction&); // - SCD nibble
+        void OP_00FB(const Instruction&); // - SCR
+        void OP_00FC(const Instruction&); // - SCL
+        void OP_00FD(const Instruction&); // - EXIT
+        void OP_00FE(const Instruction&); // - LOW
+        void OP_00FF(const Instruction&); // - HIGH
+        void OP_Fx30(const Instruction&); // - LD HF, Vx
+        void OP_Fx75(const Instruction&); // - LD R, Vx
+        void OP_Fx85(const Instruction&); // - LD Vx, R
+
+        //XO-CHIP, see: https://johnearnest.github.io/Octo/docs/XO-ChipSpecification.html
+        void OP_00Dn(const Instruction&); // - scroll-up nibble
+        void OP_5xy2(const Instruction&); // - save vx - vy
+        void OP_5xy3(const Instruction&); // - load vx - vy
+        void OP_F000(const Instruction&); // - i := long nnnn
+        void OP_Fn01(const Instruction&); // - plane n
+        void OP_F002(const Instruction&); // - audio
+        void OP_Fx3A(const Instruction&); // - pitch := vx
+
+        void cycle(); //fetch-decode-execute, timers are left to tick_timers()
+
+        //executes up to the given number of instructions a basic block at a time,
+        //returns the number of instructions executed
+        unsigned int run(unsigned int);
+
+        //one 60Hz frame: runs the given number of instructions as a batch, then ticks the timers once
+        unsigned int run_frame(unsigned int);
+
+        //opcodes no instruction of the mode decodes to, stops the machine on them with UNDEFINED_INSTR
+        void OP_NULL(const Instruction&);
+
+    private:
+        //Dxyn for hi-res, 16x16 sprites and several planes, OP_Dxyn keeps the CHIP-8 case
+        void draw_planes(const Instruction&);
+
+        //called by run() after the jump at the given address went backwards, with the instructions
+        //left in its budget; returns how many it executed or skipped, see run()
+        unsigned int idle_loop(uint16_t, unsigned int);
+
+        //stops the machine on the current instruction with the given error
+        void trap(ErrorCodes);
+        //false after a trap if size bytes from I don't fit in memory, always true when masked
+        bool check_memory(unsigned int);
 };
 
-#endif
\ No newline at end of file
+using VChip8 = VChip8Core<>;
+using VChip8Vip = VChip8Core<VChip8QuirksVip>;
+using VChip8Schip = VChip8Core<VChip8QuirksSchip>;
+using VChip8Octo = VChip8Core<VChip8QuirksOcto>;
+
+//compiled once in chip_8.cpp
+extern template class VChip8Core<VChip8Quirks, VChip8BoundsMasked>;
+extern template class VChip8Core<VChip8QuirksVip, VChip8BoundsMasked>;
+extern template class VChip8Core<VChip8QuirksSchip, VChip8BoundsMasked>;
+extern template class VChip8Core<VChip8QuirksOcto, VChip8BoundsMasked>;
+extern template class VChip8Core<VChip8Quirks, VChip8BoundsChecked>;
+extern template class VChip8Core<VChip8QuirksVip, VChip8BoundsChecked>;
+extern template class VChip8Core<VChip8QuirksSchip, VChip8BoundsChecked>;
+extern template class VChip8Core<VChip8QuirksOcto, VChip8BoundsChecked>;
+
+#endif
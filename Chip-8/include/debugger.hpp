@@ -0,0 +1,123 @@
+/*
+Debugger for a VChip8 of any quirk profile, usable in release builds.
+    1. Breakpoints on program counter values, watchpoints on memory writes (Fx33, Fx55 and XO-CHIP's
+       5xy2) and register conditions (the register changes, or takes a given value).
+    2. The interpreter is not touched. With nothing armed the debugger hands whole frames to
+       VChip8::run; once something is armed it steps one instruction at a time, the breakpoint check
+       is one lookup in a bitmap of addresses and the writes of the storing instructions are looked
+       up in a second one.
+    3. The debugger keeps the frame clock: every instructions-per-frame instructions the timers tick,
+       a machine halted on Fx0A gives up the rest of its frame, so any mix of steps and continues
+       ends in the same state as run_frame.
+    4. command() runs one line of the text protocol, serve() reads them from a stream or a local TCP
+       socket; every reply ends with a line "ok" or "error <message>". Addresses and values are hex,
+       counts are decimal:
+           break ADDR, delete ADDR            PC breakpoints
+           watch ADDR [LEN], unwatch ADDR [LEN] memory write watchpoints
+           reg Vx [VALUE], unreg Vx           stop when Vx changes (or becomes VALUE)
+           step [N], until ADDR [FRAMES], continue [FRAMES]
+           regs, mem ADDR [LEN], dis [ADDR] [N], keys BITS, help, quit
+    5. disassemble() decodes with the machine's own decode tables, so it shows what the current mode runs.
+*/
+
+#ifndef __V_CHIP_8_DEBUGGER__
+#define __V_CHIP_8_DEBUGGER__
+
+#include "chip_8.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+class VChip8Debugger{
+    public:
+        enum StopReason:uint8_t{
+            STOP_NONE,          //the budget ran out
+            STOP_BREAKPOINT,
+            STOP_WATCHPOINT,
+            STOP_REGISTER,
+            STOP_MACHINE        //the machine stopped, see VChip8::get_error_code
+        };
+
+        struct Stop{
+            StopReason reason = STOP_NONE;
+            uint16_t address = 0;   //the instruction that stopped, the breakpoint's for breakpoints
+            uint16_t target = 0;    //address written to for watchpoints, register index for conditions
+        };
+
+        //value for watch_register: any change stops
+        static const int ANY_VALUE = -1;
+
+        template<class Quirks, class Bounds>
+        explicit VChip8Debugger(VChip8Core<Quirks, Bounds>& chip8, unsigned int instructionsPerFrame = 10)
+            : chip8(chip8), core(&chip8), run_core(&run_instructions<VChip8Core<Quirks, Bounds>>){
+            this->instructions_per_frame = instructionsPerFrame > 0 ? instructionsPerFrame : 1;
+        }
+
+        VChip8Debugger(const VChip8Debugger&) = delete;
+        VChip8Debugger& operator=(const VChip8Debugger&) = delete;
+
+        void set_breakpoint(uint16_t, bool);
+        //the given number of bytes from the address
+        void set_watchpoint(uint16_t, uint16_t, bool);
+        void watch_register(unsigned int, int value = ANY_VALUE);
+        void unwatch_register(unsigned int);
+        bool armed() const;
+
+        //execute at most the given number of instructions, frames or instructions until the address
+        //is reached; a breakpoint on the program counter they start from is stepped over
+        Stop step(uint64_t);
+        Stop run_frames(uint64_t);
+        Stop run_to(uint16_t, uint64_t frames);
+
+        //frames completed so far and instructions into the current one
+        uint64_t frame() const;
+        unsigned int frame_position() const;
+
+        //"F155  LD [I], V1" for the instruction at the address
+        std::string disassemble(uint16_t) const;
+
+        //runs one line of the protocol (point 4) and writes the reply, false once it was quit
+        bool command(const std::string&, std::ostream&);
+        //commands from in until quit or the end of the input, replies to out
+        void serve(FILE*, FILE*);
+        //the same for one client of a TCP socket on 127.0.0.1, false if it couldn't be opened
+        bool serve_tcp(unsigned short);
+
+    private:
+        static const unsigned int MAP_WORDS = sizeof(VChip8Machine::memory) / 64;
+
+        VChip8Machine& chip8;
+        void* core;
+        unsigned int (*run_core)(void*, unsigned int);
+
+        unsigned int instructions_per_frame;
+        uint64_t frames = 0;
+        unsigned int position = 0;
+
+        //one bit per address
+        uint64_t breakpoints[MAP_WORDS]{};
+        uint64_t watchpoints[MAP_WORDS]{};
+        unsigned int breakpoint_count = 0;
+        unsigned int watchpoint_count = 0;
+        uint16_t register_mask = 0;
+        int register_values[16]{};
+
+        template<class Core>
+        static unsigned int run_instructions(void* core, unsigned int instructions){
+            return static_cast<Core*>(core)->run(instructions);
+        }
+
+        static bool test(const uint64_t* map, unsigned int address){
+            return (map[address / 64] >> (address % 64)) & 1u;
+        }
+        static void assign(uint64_t* map, unsigned int address, bool value, unsigned int& count);
+
+        //runs up to the given number of instruction slots of the frame clock, see point 3
+        Stop execute(uint64_t);
+        //true if the instruction at the address writes a watched byte, the first one is returned
+        bool writes_watched(uint16_t, uint16_t&) const;
+        void report(const Stop&, std::ostream&);
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+State handed between an emulation thread and a presentation thread without locks.
+    1. VChip8TripleBuffer: the emulation thread fills the back slot and publishes it, the presenter
+       picks up the most recently published slot. Neither side ever waits, frames the presenter was
+       too slow for are overwritten.
+    2. VChip8SharedKeypad: the keypad as 16 bits of one atomic, written by the thread that polls input
+       and copied into the machine by the emulation thread before every frame.
+*/
+
+#ifndef __V_CHIP_8_EXCHANGE__
+#define __V_CHIP_8_EXCHANGE__
+
+#include "chip_8.hpp"
+#include <atomic>
+#include <cstdint>
+
+//a completed frame, the packed planes as in VChip8::video_memory
+struct VChip8Frame{
+    uint64_t video_memory[VChip8::VIDEO_PLANES * VChip8::PLANE_WORDS];
+    uint64_t number;       //frames emulated before this one
+    uint64_t previous;     //number of the frame published before this one
+    uint8_t mode;          //VChip8::Mode
+    bool hires;
+    //rows [dirty_top, dirty_bottom) changed since the previous frame, taken from the machine's
+    //dirty rows (VChip8::take_dirty_rows) and merged over every frame in between
+    uint8_t dirty_top;
+    uint8_t dirty_bottom;
+
+    void capture(const VChip8Machine&, uint64_t);
+};
+
+class VChip8TripleBuffer{
+    public:
+        VChip8TripleBuffer();
+
+        VChip8TripleBuffer(const VChip8TripleBuffer&) = delete;
+        VChip8TripleBuffer& operator=(const VChip8TripleBuffer&) = delete;
+
+        //producer side: the slot to fill, then publish() swaps it with the shared one
+        VChip8Frame& back();
+        void publish();
+
+        //consumer side: takes the latest published frame if there is one the consumer hasn't
+        //seen yet, front() stays valid and unchanged until the next successful acquire()
+        bool acquire();
+        const VChip8Frame& front() const;
+
+    private:
+        static const uint8_t INDEX = 0x3;
+        static const uint8_t FRESH = 0x4;   //the shared slot was published since the last acquire
+
+        alignas(64) VChip8Frame slots[3];
+        alignas(64) std::atomic<uint8_t> shared{1};    //slot index | FRESH
+        alignas(64) uint8_t back_slot = 0;              //owned by the producer
+        alignas(64) uint8_t front_slot = 2;             //owned by the consumer
+};
+
+class VChip8SharedKeypad{
+    public:
+        //packs a 16-entry keypad into the shared bits
+        void store(const uint8_t*);
+        //unpacks the shared bits into a 16-entry keypad
+        void load(uint8_t*) const;
+
+    private:
+        std::atomic<uint16_t> keys{0};  //bit k is key k
+};
+
+#endif
@@ -0,0 +1,71 @@
+/*
+x86-64 dynamic recompiler for VChip8.
+    1. Straight-line runs of ALU, load and branch instructions starting at the program counter
+       are translated into native code, one block per start address.
+    2. Inside a block the Vx registers, the index register and the program counter live in host
+       registers, they are loaded on entry and written back once on exit.
+    3. Instructions with side effects outside the register file (drawing, key waits, timers, stack,
+       memory writes, random numbers) end the block and are run by the VChip8 interpreter, which
+       stays the reference implementation.
+    4. Every block remembers the page_generation of the memory pages it was read from, a block
+       whose pages were rewritten (Fx55/Fx33, loadRom) is translated again on its next entry.
+    5. The code buffer is mapped read/write and each page is switched to read/execute once a block
+       is written to it, so no page is ever writable and executable at the same time.
+On hosts other than x86-64 POSIX, available() is false and run() simply uses the interpreter.
+*/
+
+#ifndef __V_CHIP_8_JIT__
+#define __V_CHIP_8_JIT__
+
+#include "chip_8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class VChip8Jit{
+    public:
+        explicit VChip8Jit(VChip8&);
+        ~VChip8Jit();
+
+        VChip8Jit(const VChip8Jit&) = delete;
+        VChip8Jit& operator=(const VChip8Jit&) = delete;
+
+        //whether native code can be generated on this host
+        bool available() const;
+
+        //same contract as VChip8::run, executes up to the given number of instructions
+        unsigned int run(unsigned int);
+
+        //same contract as VChip8::run_frame
+        unsigned int run_frame(unsigned int);
+
+        //drops every translated block
+        void flush();
+
+    private:
+        //native block, takes registers[] and &index_register and returns the next program counter
+        using BlockFunc = uint16_t (*) (uint8_t*, uint16_t*);
+
+        struct Block{
+            BlockFunc code;
+            uint8_t length;       //instructions in the block, 0 if the first one must be interpreted
+            uint8_t interpreted;  //when length is 0, instructions to hand to the interpreter in one go
+            bool translated;
+            uint8_t first_page;
+            uint8_t last_page;
+            uint32_t first_generation;
+            uint32_t last_generation;
+        };
+
+        static const size_t CODE_CAPACITY = 4 << 20;
+        static const unsigned int MAX_BLOCK_LENGTH = 64;
+
+        VChip8& chip8;
+        uint8_t* code_buffer;
+        size_t code_size;
+        std::vector<Block> blocks;
+
+        void translate(uint16_t, Block&);
+};
+
+#endif
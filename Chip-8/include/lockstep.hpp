@@ -0,0 +1,87 @@
+/*
+Lockstep engine for many instances of one ROM.
+    1. The Vx registers, index registers, program counters and timers of all lanes are stored as
+       structure-of-arrays, one row of lanes per register, padded to a whole number of SIMD vectors.
+    2. Every step picks the lowest program counter among the running lanes and executes the basic
+       block found there for all lanes sitting on it (lanes that are behind catch up first, which
+       lets diverged lanes meet again at loop heads and joins).
+    3. ALU, load, timer and branch instructions run on all lanes of the group at once with AVX2/SSE2
+       byte operations under a lane mask, everything else falls back to the VChip8 handlers lane by
+       lane, which stay the reference semantics. The AVX2 forms are compiled in when the compiler
+       targets AVX2, e.g. with the VCHIP8_AVX2 CMake option, otherwise SSE2 is used.
+    4. Memory, display, stack and keypad stay in one VChip8 per lane, see machine(). A lane whose
+       code pages were rewritten only joins a group if its code still matches the group's.
+    5. Lanes in SUPER-CHIP or XO-CHIP mode (set on machine(0) before loadRom) run on the interpreter.
+*/
+
+#ifndef __V_CHIP_8_LOCKSTEP__
+#define __V_CHIP_8_LOCKSTEP__
+
+#include "chip_8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class VChip8Lockstep{
+    public:
+        explicit VChip8Lockstep(unsigned int lanes);
+
+        VChip8Lockstep(const VChip8Lockstep&) = delete;
+        VChip8Lockstep& operator=(const VChip8Lockstep&) = delete;
+
+        //loads the ROM into every lane, check get_error_code() afterwards
+        void loadRom(const char*);
+        void loadRom(const uint8_t*, size_t);
+
+        unsigned int size() const;
+
+        //memory, display, stack, keypad and RNG of a lane, its registers, index register, program
+        //counter and timers are only current after store_lanes() and are read back by load_lanes()
+        VChip8& machine(unsigned int);
+
+        //copies the per-lane VChip8 registers into the arrays and back
+        void load_lanes();
+        void store_lanes();
+
+        int get_error_code(unsigned int);
+
+        //every lane executes up to the given number of instructions, returns the total over all lanes
+        uint64_t run(unsigned int);
+
+        //one 60Hz frame on every lane, see VChip8::run_frame
+        uint64_t run_frame(unsigned int);
+
+        void tick_timers();
+
+    private:
+        static const unsigned int LANE_ALIGN = 32;
+        static const unsigned int MAX_BLOCK_LENGTH = 32;
+
+        unsigned int lanes;
+        unsigned int stride; //lanes rounded up to LANE_ALIGN
+
+        std::vector<std::unique_ptr<VChip8>> machines;
+
+        std::vector<uint8_t> registers;   //16 rows of stride lanes
+        std::vector<uint16_t> index_register;
+        std::vector<uint16_t> program_counter;
+        std::vector<uint8_t> delay_timer;
+        std::vector<uint8_t> sound_timer;
+
+        std::vector<uint8_t> active;      //0xFF for the lanes of the current group
+        std::vector<uint32_t> executed;   //instructions executed by each lane in the current run
+        uint32_t baseline_generation[0x1000 / 256]; //page generations right after loadRom
+
+        uint8_t* row(unsigned int r){
+            return &this->registers[r * this->stride];
+        }
+
+        //copies lane 0 right after its loadRom into the other lanes
+        void share_first_lane();
+        bool code_matches(unsigned int, unsigned int, uint16_t, unsigned int);
+        void execute_vector(const VChip8::Instruction&, uint16_t);
+        void execute_lane(unsigned int, const VChip8::Instruction&, uint16_t);
+};
+
+#endif
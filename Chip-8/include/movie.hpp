@@ -0,0 +1,56 @@
+/*
+Input movies: the keypad state of every frame of a run, for exact replay.
+A movie stores the RNG seed, instructions per frame and mode of the run and the keypad only on the
+frames where it changed. Replaying it into a VChip8 built with the same seed, mode and ROM
+reproduces the run frame by frame.
+File format, little endian:
+    "VC8M", uint8 version, uint32 instructions per frame, uint32 seed, uint64 frame count,
+    uint8 mode (VChip8::Mode),
+    then one event per keypad change: LEB128 frames since the previous event, uint16 keypad bits.
+*/
+
+#ifndef __V_CHIP_8_MOVIE__
+#define __V_CHIP_8_MOVIE__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class VChip8Movie{
+    public:
+        uint32_t seed = 0;
+        uint32_t instructions_per_frame = 0;
+        uint8_t mode = 0;
+
+        //appends the keypad state of the given frame, frames must be recorded in order
+        void record(uint64_t, const uint8_t*);
+
+        //writes the recorded keypad state of the given frame into the keypad,
+        //frames are expected in order, seeking back restarts from the first event
+        void apply(uint64_t, uint8_t*);
+
+        //first frame after the given one on which the keypad changes, UINT64_MAX if none does;
+        //lets a scheduler skip the frames in between (see VChip8Runner)
+        uint64_t next_event(uint64_t) const;
+
+        //frames covered by the movie
+        uint64_t frames() const;
+
+        bool save(const char*) const;
+        bool load(const char*);
+
+    private:
+        struct Event{
+            uint64_t frame;
+            uint16_t keys; //bit k is key k
+        };
+
+        static const uint8_t VERSION = 1;
+
+        std::vector<Event> events;
+        uint64_t frame_count = 0;
+        size_t cursor = 0; //next event apply() has not reached yet
+        uint16_t current = 0;
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+Frame pacing with absolute deadlines.
+    1. Every wait() sleeps until the next deadline on the monotonic clock (clock_nanosleep with
+       TIMER_ABSTIME where available), waking a short spin margin early and spinning the rest, so an
+       idle instance costs next to no CPU while frames still start within microseconds of their deadline.
+    2. Deadlines advance by exactly one period, so oversleeping one frame doesn't shift the ones after it.
+       A caller that falls more than max_behind periods behind (a stall, a debugger) skips the missed
+       deadlines instead of racing through them, the skips are counted.
+    3. stats() reports how late the waits woke up: mean, standard deviation (jitter) and maximum.
+*/
+
+#ifndef __V_CHIP_8_PACER__
+#define __V_CHIP_8_PACER__
+
+#include <chrono>
+#include <cstdint>
+
+class VChip8Pacer{
+    public:
+        struct Stats{
+            uint64_t frames;           //waits completed
+            uint64_t skipped;          //deadlines dropped after falling behind
+            double mean_lateness_us;   //wake-up time past the deadline
+            double jitter_us;          //standard deviation of the lateness
+            double max_lateness_us;
+        };
+
+        explicit VChip8Pacer(std::chrono::nanoseconds period,
+                             std::chrono::nanoseconds spin = std::chrono::microseconds(100),
+                             unsigned int max_behind = 4);
+
+        //the first deadline is one period from now
+        void start();
+
+        //blocks until the next deadline and moves it one period on
+        void wait();
+
+        Stats stats() const;
+
+    private:
+        int64_t period;     //nanoseconds
+        int64_t spin;
+        unsigned int max_behind;
+        int64_t deadline = 0;
+
+        uint64_t frames = 0;
+        uint64_t skipped = 0;
+        double lateness_sum = 0;
+        double lateness_squares = 0;
+        int64_t lateness_max = 0;
+
+        static int64_t now();
+        static void sleep_until(int64_t);
+};
+
+#endif
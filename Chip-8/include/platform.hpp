@@ -1,12 +1,25 @@
 #include <SDL.h>
+#include "audio.hpp"
 
 class Platform{
     SDL_Window* window{};
     SDL_Renderer* renderer{};
     SDL_Texture* texture{};
+    int textureWidth{};
+    bool exposed = true; //window contents were lost, the next update must present even without new rows
+    bool rewindHeld = false;
+    SDL_AudioDeviceID audioDevice = 0;
     public:
         Platform(const char*, int,  int , int, int);
         ~Platform();
-        void update(void const*, int);
-        bool processInput(uint8_t * );      
+        //uploads rows [top, bottom) of the full-frame buffer, an empty range only re-presents if the window was exposed
+        void update(void const*, int, int, int);
+        bool processInput(uint8_t * );
+        //true while Backspace is held, the emulation runs backwards through its rewind history
+        bool rewinding() const;
+        //replaces the texture with one of the given size (SUPER-CHIP resolution switches), the window keeps its size
+        void resize(int, int);
+        //plays the synth's output until destruction, the callback runs on SDL's audio thread,
+        //returns false (and stays silent) if no device could be opened
+        bool startAudio(VChip8AudioSynth&);      
 };
\ No newline at end of file
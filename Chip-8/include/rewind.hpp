@@ -0,0 +1,70 @@
+/*
+Rewind history for VChip8, one snapshot per captured frame in a fixed memory budget.
+    1. Every keyframe_interval frames a full snapshot (keyframe) is stored, the frames in between
+       are stored as the XOR of their snapshot with the keyframe, run-length encoded. Most of the
+       state does not change between frames so a delta is a few dozen bytes.
+    2. Records live in one ring of budget bytes, when it is full the oldest keyframe is dropped
+       together with its deltas.
+    3. Every delta depends on its keyframe only, seeking to any frame decodes one keyframe and at
+       most one delta.
+*/
+
+#ifndef __V_CHIP_8_REWIND__
+#define __V_CHIP_8_REWIND__
+
+#include "chip_8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class VChip8Rewind{
+    public:
+        //budget is the size of the ring in bytes
+        explicit VChip8Rewind(size_t budget, unsigned int keyframe_interval = 60);
+
+        //stores the current state as the newest frame, call once per frame
+        void capture(const VChip8Machine&);
+
+        //number of frames that can be sought to, frame 0 is the newest
+        size_t frames() const;
+
+        //decodes the state the given number of frames back, false if it is not in the history
+        bool seek(size_t, VChip8::Snapshot&) const;
+
+        //restores the state the given number of frames back and forgets every newer frame,
+        //so the next capture continues from there
+        bool rewind(VChip8Machine&, size_t);
+
+        void clear();
+
+        //bytes of the ring taken by stored frames
+        size_t memory_used() const;
+
+    private:
+        struct Record{
+            size_t offset;      //position in the ring
+            size_t size;        //encoded bytes
+            uint64_t sequence;  //frame number, increments with every capture
+            uint64_t keyframe;  //sequence of the keyframe this frame is encoded against
+        };
+
+        static const size_t NO_SPACE = (size_t)-1;
+
+        std::vector<uint8_t> ring;
+        std::deque<Record> records;
+        unsigned int keyframe_interval;
+        uint64_t next_sequence;
+        size_t used;
+
+        VChip8::Snapshot keyframe; //decoded keyframe of the newest frame
+        std::vector<uint8_t> scratch;
+
+        size_t allocate(size_t, bool);
+        void drop_oldest();
+        void store(const uint8_t*, size_t, uint64_t);
+        static size_t encode(const uint8_t*, const uint8_t*, size_t, uint8_t*);
+        static void decode(const uint8_t*, size_t, uint8_t*);
+};
+
+#endif
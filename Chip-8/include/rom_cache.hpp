@@ -0,0 +1,91 @@
+/*
+Process-wide cache of ROM images shared by every VChip8 instance.
+    1. A ROM file is read into memory once (ROMs are at most 64KB, so no live mapping is kept that
+       a truncated or rewritten file could fault or change) and keyed by the 64-bit FNV-1a hash of
+       its contents, files with identical contents share one image.
+    2. Reopening a path whose size and modification time did not change returns the cached image
+       without touching the file contents again.
+    3. Images are reference counted, VChip8::loadRom copies an image into memory with one memcpy,
+       so instances never hold on to them.
+    4. All members are safe to call from several threads at once.
+    5. Because images are shared by content, VChip8RomImage::path() is only the first file a content
+       was read from; open_directory() returns the path of every file next to its image.
+*/
+
+#ifndef __V_CHIP_8_ROM_CACHE__
+#define __V_CHIP_8_ROM_CACHE__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VChip8RomImage{
+    public:
+        VChip8RomImage(const VChip8RomImage&) = delete;
+        VChip8RomImage& operator=(const VChip8RomImage&) = delete;
+
+        const uint8_t* data() const;
+        size_t size() const;
+        uint64_t hash() const;
+        //path the image was first read from, other files with the same contents share the image
+        const std::string& path() const;
+
+    private:
+        friend class VChip8RomCache;
+        VChip8RomImage() = default;
+
+        uint64_t content_hash = 0;
+        std::string file_path;
+        std::vector<uint8_t> buffer;
+};
+
+//a file of a ROM directory and its (possibly shared) image
+struct VChip8RomFile{
+    std::string path;
+    std::shared_ptr<const VChip8RomImage> image;
+};
+
+class VChip8RomCache{
+    public:
+        //the cache VChip8::loadRom goes through
+        static VChip8RomCache& shared();
+
+        VChip8RomCache() = default;
+        VChip8RomCache(const VChip8RomCache&) = delete;
+        VChip8RomCache& operator=(const VChip8RomCache&) = delete;
+
+        //image of a ROM file, nullptr if it couldn't be read
+        std::shared_ptr<const VChip8RomImage> open(const char*);
+
+        //every .ch8, .sc8 and .xo8 file of a directory with its image, sorted by file name, unreadable
+        //files are skipped and other files are not read
+        std::vector<VChip8RomFile> open_directory(const char*);
+
+        //true for the extensions open_directory() picks up
+        static bool is_rom_file(const std::string&);
+
+        //distinct images held by the cache
+        size_t size() const;
+
+        //drops the cache's references, images still in use stay valid until released
+        void clear();
+
+    private:
+        struct PathEntry{
+            uint64_t file_size;
+            int64_t modified;   //modification time in nanoseconds
+            std::shared_ptr<const VChip8RomImage> image;
+        };
+
+        mutable std::mutex lock;
+        std::unordered_map<std::string, PathEntry> by_path;
+        std::unordered_map<uint64_t, std::vector<std::shared_ptr<const VChip8RomImage>>> by_hash;
+
+        std::shared_ptr<const VChip8RomImage> intern(std::unique_ptr<VChip8RomImage>);
+};
+
+#endif
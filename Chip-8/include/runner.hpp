@@ -0,0 +1,82 @@
+/*
+In-process runner for large numbers of VChip8 sessions.
+    1. The runner owns the instances, callers add them, load ROMs and seed them before run().
+    2. run() shards the instances across one worker thread per core, every worker owns a
+       contiguous range of instance indices and takes work from its front.
+    3. A worker whose range is empty steals the back half of another worker's range, ranges are
+       a single atomic word so taking and stealing is a compare-and-swap, no locks are held.
+    4. Every instance has its own result slot, written only by the worker that ran it, with the frame
+       hashes of the checkpoints if set_checkpoints() asked for them.
+    5. An instance halted on Fx0A (see VChip8::halted) is parked: its frames are not dispatched,
+       only its timers tick, until a key event wakes it. Key events come from the instance's
+       input movie (set_input), without one a parked instance sleeps to the end of the run.
+*/
+
+#ifndef __V_CHIP_8_RUNNER__
+#define __V_CHIP_8_RUNNER__
+
+#include "chip_8.hpp"
+#include "movie.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class VChip8Runner{
+    public:
+        //outcome of one instance after run()
+        struct Result{
+            uint64_t instructions;  //instructions executed
+            uint64_t frames;        //frames executed
+            uint64_t parked_frames; //frames spent halted on Fx0A, only the timers ran
+            uint64_t frame_hash;    //VChip8::get_frame_hash() of the final display
+            int error_code;         //VChip8::get_error_code(), ALL_OKAY if the run completed
+            std::vector<uint64_t> checkpoints;  //VChip8::get_frame_hash() after every checkpoint interval of frames
+        };
+
+        //0 threads means one per hardware thread
+        explicit VChip8Runner(unsigned int threads = 0);
+
+        VChip8Runner(const VChip8Runner&) = delete;
+        VChip8Runner& operator=(const VChip8Runner&) = delete;
+
+        //creates a new instance owned by the runner, load and seed it before run()
+        VChip8& add();
+
+        //records the frame hash of every instance each given number of frames, 0 (the default) for none
+        void set_checkpoints(uint64_t);
+
+        //replays the movie's keypad into the instance, one frame at a time, see VChip8Movie::apply
+        void set_input(size_t, const VChip8Movie&);
+
+        size_t size() const;
+        unsigned int thread_count() const;
+
+        VChip8& instance(size_t);
+
+        //runs every instance for the given number of 60Hz frames of the given instructions each,
+        //an instance stops early on an error, blocks until all instances are done
+        void run(uint64_t frames, unsigned int instructionsPerFrame);
+
+        //one slot per instance, in the order they were added
+        const std::vector<Result>& results() const;
+
+    private:
+        //a worker's range of instance indices, begin in the low half and end in the high half
+        struct alignas(64) Range{
+            std::atomic<uint64_t> bounds;
+        };
+
+        unsigned int threads;
+        uint64_t checkpoint_interval = 0;
+        std::vector<std::unique_ptr<VChip8>> instances;
+        std::vector<std::unique_ptr<VChip8Movie>> inputs;   //null for instances without input
+        std::vector<Result> slots;
+
+        void work(std::vector<Range>&, unsigned int, uint64_t, unsigned int);
+        static bool take(Range&, uint32_t&);
+        static bool steal(Range&, Range&, uint32_t&);
+};
+
+#endif
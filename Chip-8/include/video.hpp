@@ -0,0 +1,36 @@
+/*
+Helpers for presenting VChip8's bit-packed display.
+The core keeps one bit per pixel (see VChip8::video_memory), frames are only expanded to
+32-bit RGBA when they are handed to a renderer. A hi-res row is two words, so rows of either
+resolution expand as a run of words.
+Expanded frames can be scaled in software for captures and thumbnails that have no renderer,
+the scalers work on whole RGBA frames and write the scaled frame row after row.
+*/
+
+#ifndef __V_CHIP_8_VIDEO__
+#define __V_CHIP_8_VIDEO__
+
+#include <cstdint>
+
+const uint32_t PIXEL_ON = 0xFFFFFFFFu;
+const uint32_t PIXEL_OFF = 0x00000000u;
+
+//expands rows of 64 packed pixels (most significant bit first) into 64 RGBA words each,
+//rows are written one after another into rgba
+void expand_pixels(const uint64_t* rows, unsigned int count, uint32_t* rgba,
+                   uint32_t on = PIXEL_ON, uint32_t off = PIXEL_OFF);
+
+//expands words of two XO-CHIP planes together, every pixel becomes palette[bit of plane0 | bit of plane1 << 1]
+void expand_planes(const uint64_t* plane0, const uint64_t* plane1, unsigned int count, uint32_t* rgba,
+                   const uint32_t palette[4]);
+
+//every pixel becomes a factor x factor block, dst holds (width * factor) x (height * factor) pixels
+void scale_nearest(const uint32_t* src, unsigned int width, unsigned int height, unsigned int factor, uint32_t* dst);
+
+//Scale2x/EPX, doubles the size and rounds the corners of diagonal edges instead of leaving steps
+void scale_epx(const uint32_t* src, unsigned int width, unsigned int height, uint32_t* dst);
+
+//nearest with the last row of every block at half brightness (alpha kept), factor 2 or more
+void scale_scanlines(const uint32_t* src, unsigned int width, unsigned int height, unsigned int factor, uint32_t* dst);
+
+#endif
@@ -0,0 +1,271 @@
+#include "../include/chip_8.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+//Ahead-of-time recompiler: analyzes a ROM from 0x200 and writes a C++ translation unit with one
+//native function per reachable basic block, see aot.hpp for the runtime side.
+
+namespace {
+
+    const uint16_t ROM_MEM = 0x200;
+
+    struct Analysis{
+        std::vector<uint8_t> rom;
+        std::vector<bool> reached;    //an instruction starts at this address
+        std::set<uint16_t> leaders;   //a block starts at this address
+        std::vector<uint16_t> worklist;
+        VChip8 decoder;
+
+        bool in_rom(unsigned int address) const{
+            return address >= ROM_MEM && address + 1u < ROM_MEM + this->rom.size();
+        }
+
+        uint16_t opcode(uint16_t address) const{
+            return (this->rom[address - ROM_MEM] << 8u) | this->rom[address + 1u - ROM_MEM];
+        }
+
+        void leader(unsigned int address){
+            if (this->in_rom(address) && this->leaders.insert(address).second)
+                this->worklist.push_back(address);
+        }
+
+        //follows straight-line code from an address, queueing every successor block
+        void explore(uint16_t address){
+            while (this->in_rom(address)){
+                //falling into code reached from elsewhere splits the block there
+                if (this->reached[address]){
+                    leader(address);
+                    return;
+                }
+                this->reached[address] = true;
+
+                VChip8::Instruction instr = this->decoder.decode(opcode(address));
+                switch (instr.id)
+                {
+                case VChip8::ID_1nnn:
+                    leader(instr.nnn);
+                    return;
+                case VChip8::ID_2nnn:
+                    leader(instr.nnn);
+                    leader(address + 2);
+                    return;
+                case VChip8::ID_00EE:
+                case VChip8::ID_Bnnn:
+                    //returns land on call sites' successors, computed jumps are left to the interpreter
+                    return;
+                case VChip8::ID_3xkk: case VChip8::ID_4xkk: case VChip8::ID_5xy0: case VChip8::ID_9xy0:
+                case VChip8::ID_Ex9E: case VChip8::ID_ExA1:
+                    leader(address + 2);
+                    leader(address + 4);
+                    return;
+                case VChip8::ID_Fx0A:
+                    //waiting re-executes the instruction, so it starts a block of its own
+                    leader(address);
+                    leader(address + 2);
+                    return;
+                case VChip8::ID_Fx33: case VChip8::ID_Fx55: case VChip8::ID_NULL:
+                    //memory writes may change the code that follows
+                    leader(address + 2);
+                    return;
+                }
+                address += 2;
+                if (this->leaders.count(address)){
+                    return;
+                }
+            }
+        }
+
+        void run(){
+            this->reached.assign(0x1000, false);
+            leader(ROM_MEM);
+            while (!this->worklist.empty()){
+                uint16_t address = this->worklist.back();
+                this->worklist.pop_back();
+                if (!this->reached[address])
+                    explore(address);
+            }
+        }
+    };
+
+    //instructions that keep a block going, same set as VChip8::decode_block
+    bool straight_line(uint8_t id){
+        switch (id)
+        {
+        case VChip8::ID_00E0: case VChip8::ID_6xkk: case VChip8::ID_7xkk: case VChip8::ID_8xy0: case VChip8::ID_8xy1:
+        case VChip8::ID_8xy2: case VChip8::ID_8xy3: case VChip8::ID_8xy4: case VChip8::ID_8xy5: case VChip8::ID_8xy6:
+        case VChip8::ID_8xy7: case VChip8::ID_8xyE: case VChip8::ID_Annn: case VChip8::ID_Cxkk: case VChip8::ID_Dxyn:
+        case VChip8::ID_Fx07: case VChip8::ID_Fx15: case VChip8::ID_Fx18: case VChip8::ID_Fx1E: case VChip8::ID_Fx29:
+        case VChip8::ID_Fx65:
+            return true;
+        }
+        return false;
+    }
+
+    std::string format(const char* pattern, unsigned int a = 0, unsigned int b = 0, unsigned int c = 0){
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), pattern, a, b, c);
+        return buffer;
+    }
+
+    //C++ for one instruction, mirrors the OP_* handlers; returns false if a handler has to run it
+    bool translate(const VChip8::Instruction& instr, uint16_t address, std::string& out){
+        unsigned int x = instr.x, y = instr.y;
+        switch (instr.id)
+        {
+        case VChip8::ID_6xkk: out = format("v[%u] = 0x%02X;", x, instr.kk); return true;
+        case VChip8::ID_7xkk: out = format("v[%u] += 0x%02X;", x, instr.kk); return true;
+        case VChip8::ID_8xy0: out = format("v[%u] = v[%u];", x, y); return true;
+        case VChip8::ID_8xy1: out = format("v[%u] |= v[%u];", x, y); return true;
+        case VChip8::ID_8xy2: out = format("v[%u] &= v[%u];", x, y); return true;
+        case VChip8::ID_8xy3: out = format("v[%u] ^= v[%u];", x, y); return true;
+        case VChip8::ID_8xy4:
+            out = format("{ unsigned int sum = v[%u] + v[%u]; v[15] = sum > 255u; v[%u] = sum & 0xFFu; }", x, y, x);
+            return true;
+        case VChip8::ID_8xy5:
+            out = format("v[15] = v[%u] > v[%u]; ", x, y) +
+                  format("v[%u] -= v[%u];", x, y);
+            return true;
+        case VChip8::ID_8xy6:
+            out = format("v[15] = v[%u] & 1u; v[%u] >>= 1;", x, x);
+            return true;
+        case VChip8::ID_8xy7:
+            out = format("v[15] = v[%u] > v[%u]; ", x, y) +
+                  format("v[%u] = v[%u] - v[%u];", x, y, x);
+            return true;
+        case VChip8::ID_8xyE:
+            out = format("v[15] = (v[%u] & 0x80u) >> 7u; v[%u] = v[%u] << 1;", x, x, x);
+            return true;
+        case VChip8::ID_Annn: out = format("c.index_register = 0x%03X;", instr.nnn); return true;
+        case VChip8::ID_Fx07: out = format("v[%u] = c.delay_timer;", x); return true;
+        case VChip8::ID_Fx15: out = format("c.delay_timer = v[%u];", x); return true;
+        case VChip8::ID_Fx18: out = format("c.sound_timer = v[%u];", x); return true;
+        case VChip8::ID_Fx1E: out = format("c.index_register += v[%u];", x); return true;
+        case VChip8::ID_Fx29: out = format("c.index_register = 0x050 + 5 * v[%u];", x); return true;
+        case VChip8::ID_1nnn: out = format("c.program_counter = 0x%03X;", instr.nnn); return true;
+        case VChip8::ID_3xkk:
+            out = format("c.program_counter = v[%u] == 0x%02X ? ", x, instr.kk) + format("0x%03X : 0x%03X;", address + 4, address + 2);
+            return true;
+        case VChip8::ID_4xkk:
+            out = format("c.program_counter = v[%u] != 0x%02X ? ", x, instr.kk) + format("0x%03X : 0x%03X;", address + 4, address + 2);
+            return true;
+        case VChip8::ID_5xy0:
+            out = format("c.program_counter = v[%u] == v[%u] ? ", x, y) + format("0x%03X : 0x%03X;", address + 4, address + 2);
+            return true;
+        case VChip8::ID_9xy0:
+            out = format("c.program_counter = v[%u] != v[%u] ? ", x, y) + format("0x%03X : 0x%03X;", address + 4, address + 2);
+            return true;
+        }
+        return false;
+    }
+
+    void usage(const char* program){
+        std::fprintf(stderr, "Usage: %s <ROM> <output.cpp> [--name NAME]\n"
+                             "  --name NAME  C identifier of the program (default: rom)\n", program);
+        std::exit(EXIT_FAILURE);
+    }
+
+}
+
+int main(int argc, char** argv){
+
+    if (argc != 3 && !(argc == 5 && std::strcmp(argv[3], "--name") == 0))
+        usage(argv[0]);
+    const char* romFilename = argv[1];
+    const char* outputFilename = argv[2];
+    std::string name = argc == 5 ? argv[4] : "rom";
+
+    std::ifstream file(romFilename, std::ios::in | std::ios::binary);
+    if (!file.is_open()){
+        std::fprintf(stderr, "Couldn't read %s\n", romFilename);
+        return -1;
+    }
+    Analysis analysis;
+    analysis.rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (analysis.rom.size() > 0xFFFu - ROM_MEM){
+        std::fprintf(stderr, "Error, size of ROM is larger than the memory.\n");
+        return -1;
+    }
+    analysis.run();
+
+    std::string out;
+    out += "//Generated by VChip8Aot from " + std::string(romFilename) + ", do not edit.\n";
+    out += "#include \"aot.hpp\"\n#include <cstring>\n\nnamespace {\n\n";
+
+    out += "const uint8_t rom[] = {";
+    for (size_t i = 0; i < analysis.rom.size(); i++)
+        out += format(i % 16 ? " 0x%02X," : "\n    0x%02X,", analysis.rom[i]);
+    out += "\n};\n\n";
+
+    //a block runs from its leader to the first terminator or the next leader
+    struct Block{
+        uint16_t start, end;
+        unsigned int length;
+    };
+    std::vector<Block> blocks;
+    for (uint16_t start : analysis.leaders){
+        uint16_t address = start;
+        unsigned int count = 0;
+        std::string body;
+        bool fallthrough = true;
+        while (analysis.in_rom(address) && (count == 0 || !analysis.leaders.count(address))){
+            VChip8::Instruction instr = analysis.decoder.decode(analysis.opcode(address));
+            body += format("    //0x%03X: %04X ", address, analysis.opcode(address)) + VChip8::instr_names[instr.id] + "\n";
+
+            std::string code;
+            if (translate(instr, address, code)){
+                body += "    " + code + "\n";
+            }
+            else{
+                //the handler sees the program counter the interpreter would give it
+                //registers go through memory around the call since the handler reads and writes them
+                body += format("    { static const VChip8::Instruction i = { %u, %u, %u, ", instr.id, instr.x, instr.y) +
+                        format("0x%02X, 0x%03X, %u, 1 };\n", instr.kk, instr.nnn, instr.n);
+                body += "      std::memcpy(c.registers, v, sizeof(v)); ";
+                if (!straight_line(instr.id))
+                    body += format("c.program_counter = 0x%03X; ", address + 2);
+                body += std::string("c.OP_") + VChip8::instr_names[instr.id] + "(i); std::memcpy(v, c.registers, sizeof(v)); }\n";
+            }
+            ++count;
+            address += 2;
+            if (!straight_line(instr.id)){
+                fallthrough = false;
+                break;
+            }
+        }
+        if (fallthrough)
+            body += format("    c.program_counter = 0x%03X;\n", address);
+        body += "    std::memcpy(c.registers, v, sizeof(v));\n";
+
+        //the registers live in a local copy the compiler can keep in host registers
+        out += format("void block_%03X(VChip8& c){\n", start);
+        out += "    uint8_t v[16];\n    std::memcpy(v, c.registers, sizeof(v));\n" + body + "}\n\n";
+        blocks.push_back(Block{ start, address, count });
+    }
+
+    out += "const VChip8AotBlock blocks[] = {\n";
+    for (const Block& block : blocks)
+        out += format("    { 0x%03X, 0x%03X, %u, ", block.start, block.end, block.length) + format("block_%03X },\n", block.start);
+    out += "};\n\n";
+
+    out += "}\n\n";
+    out += "extern const VChip8AotProgram vchip8_aot_" + name + ";\n";
+    out += "const VChip8AotProgram vchip8_aot_" + name + " = { \"" + name + "\", rom, sizeof(rom), blocks, " +
+           format("%u };\n\n", (unsigned int)blocks.size());
+    out += "namespace {\n    struct Registration{\n        Registration(){ vchip8_aot_register(&vchip8_aot_" + name +
+           "); }\n    } registration;\n}\n";
+
+    std::ofstream output(outputFilename, std::ios::out | std::ios::trunc);
+    if (!output.is_open()){
+        std::fprintf(stderr, "Couldn't write %s\n", outputFilename);
+        return -1;
+    }
+    output << out;
+    std::fprintf(stderr, "%s: %u blocks\n", romFilename, (unsigned int)blocks.size());
+    return output.good() ? 0 : -1;
+}
@@ -0,0 +1,110 @@
+#include "../include/aot.hpp"
+#include <cstring>
+
+namespace {
+
+    //function-local so registration from other translation units' static initializers is safe
+    std::vector<const VChip8AotProgram*>& programs(){
+        static std::vector<const VChip8AotProgram*> list;
+        return list;
+    }
+
+    const uint16_t ROM_MEM = 0x200; //see VChip8::ROM_MEM
+
+    bool rom_loaded(const VChip8& chip8, const VChip8AotProgram& program){
+        //compiled blocks are CHIP-8 code
+        return chip8.get_mode() == VChip8::MODE_CHIP8 &&
+               program.rom_size <= 0x1000u - ROM_MEM &&
+               std::memcmp(chip8.memory + ROM_MEM, program.rom, program.rom_size) == 0;
+    }
+
+}
+
+void vchip8_aot_register(const VChip8AotProgram* program){
+    programs().push_back(program);
+}
+
+const std::vector<const VChip8AotProgram*>& VChip8AotRunner::registered(){
+    return programs();
+}
+
+VChip8AotRunner::VChip8AotRunner(VChip8& chip8) : chip8(chip8), compiled(nullptr){
+    for (const VChip8AotProgram* program : programs()){
+        if (rom_loaded(chip8, *program)){
+            attach(program);
+            break;
+        }
+    }
+}
+
+VChip8AotRunner::VChip8AotRunner(VChip8& chip8, const VChip8AotProgram& program) : chip8(chip8), compiled(nullptr){
+    if (rom_loaded(chip8, program))
+        attach(&program);
+}
+
+void VChip8AotRunner::attach(const VChip8AotProgram* program){
+    this->compiled = program;
+    this->entries.assign(0x1000, nullptr);
+    for (size_t i = 0; i < program->block_count; i++)
+        this->entries[program->blocks[i].start] = &program->blocks[i];
+    std::memcpy(this->verified_generation, this->chip8.page_generation, sizeof(this->verified_generation));
+    for (unsigned int page = 0; page < 0x1000 / 256; page++)
+        this->mismatched_generation[page] = this->verified_generation[page] - 1u;
+}
+
+const VChip8AotProgram* VChip8AotRunner::program() const{
+    return this->compiled;
+}
+
+bool VChip8AotRunner::intact(const VChip8AotBlock& block){
+    //pages nobody wrote to since the ROM was checked still hold the compiled code; a written page
+    //is compared with the ROM once per generation, every compiled block on it lies in the ROM's part
+    bool written = false;
+    for (unsigned int page = block.start / 256; page <= (block.end - 1u) / 256u; page++){
+        uint32_t generation = this->chip8.page_generation[page];
+        if (generation == this->verified_generation[page])
+            continue;
+        if (generation != this->mismatched_generation[page]){
+            size_t begin = page * 256u > ROM_MEM ? page * 256u : ROM_MEM;
+            size_t end = page * 256u + 256u < ROM_MEM + this->compiled->rom_size ? page * 256u + 256u : ROM_MEM + this->compiled->rom_size;
+            if (begin < end && std::memcmp(this->chip8.memory + begin, this->compiled->rom + (begin - ROM_MEM), end - begin) == 0){
+                this->verified_generation[page] = generation;
+                continue;
+            }
+            this->mismatched_generation[page] = generation;
+        }
+        written = true;
+    }
+    if (!written)
+        return true;
+    //data elsewhere on the page changed, the block itself may not have
+    return (size_t)(block.end - ROM_MEM) <= this->compiled->rom_size &&
+           std::memcmp(this->chip8.memory + block.start, this->compiled->rom + (block.start - ROM_MEM), block.end - block.start) == 0;
+}
+
+unsigned int VChip8AotRunner::run(unsigned int instructions){
+    if (!this->compiled || this->chip8.get_mode() != VChip8::MODE_CHIP8)
+        return this->chip8.run(instructions);
+
+    //halted on Fx0A, see VChip8::halted
+    if (!this->chip8.wake())
+        return 0;
+    unsigned int executed = 0;
+    while (executed < instructions && this->chip8.get_error_code() == VChip8::ALL_OKAY && !this->chip8.halted){
+        uint16_t pc = this->chip8.program_counter;
+        const VChip8AotBlock* block = pc < 0x1000 ? this->entries[pc] : nullptr;
+        if (block && block->length <= instructions - executed && intact(*block)){
+            block->code(this->chip8);
+            executed += block->length;
+        }
+        else
+            executed += this->chip8.run(1);
+    }
+    return executed;
+}
+
+unsigned int VChip8AotRunner::run_frame(unsigned int instructions){
+    unsigned int executed = run(instructions);
+    this->chip8.tick_timers();
+    return executed;
+}
@@ -0,0 +1,176 @@
+#include "../include/audio.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+    //square wave of 4 bits on, 4 bits off, 500Hz at the default pitch
+    const uint8_t BUZZER_PATTERN[16] = {
+        0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+        0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0
+    };
+
+    const uint64_t PATTERN_BITS = 128;
+
+    void put(std::ofstream& file, uint32_t value, unsigned int bytes){
+        for (unsigned int i = 0; i < bytes; i++)
+            file.put((char)((value >> (8 * i)) & 0xFFu));
+    }
+
+}
+
+VChip8AudioFrame VChip8AudioFrame::capture(const VChip8Machine& chip8){
+    VChip8AudioFrame frame;
+    if (chip8.get_mode() == VChip8::MODE_XOCHIP){
+        std::memcpy(frame.pattern, chip8.audio_pattern, sizeof(frame.pattern));
+        frame.pitch = chip8.pitch;
+    }
+    else{
+        std::memcpy(frame.pattern, BUZZER_PATTERN, sizeof(frame.pattern));
+        frame.pitch = 64;
+    }
+    frame.active = chip8.sound_timer > 0;
+    return frame;
+}
+
+bool VChip8AudioRing::push(const VChip8AudioFrame& frame){
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->head.load(std::memory_order_acquire) == CAPACITY)
+        return false;
+    this->frames[tail % CAPACITY] = frame;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool VChip8AudioRing::pop(VChip8AudioFrame& frame){
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail.load(std::memory_order_acquire))
+        return false;
+    frame = this->frames[head % CAPACITY];
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t VChip8AudioRing::size() const{
+    return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+}
+
+VChip8AudioSynth::VChip8AudioSynth(VChip8AudioRing& ring, unsigned int sample_rate, int16_t amplitude)
+    : ring(ring), sample_rate(sample_rate > 0 ? sample_rate : 44100), amplitude(amplitude){
+}
+
+size_t VChip8AudioSynth::max_frame_samples() const{
+    return (this->sample_rate + 59) / 60;
+}
+
+unsigned int VChip8AudioSynth::get_sample_rate() const{
+    return this->sample_rate;
+}
+
+void VChip8AudioSynth::next_frame(){
+    //a producer running ahead (turbo, a stalled audio device) would otherwise add latency
+    while (this->ring.size() > MAX_QUEUED)
+        this->ring.pop(this->current);
+
+    if (this->ring.pop(this->current))
+        this->held = 0;
+    else if (++this->held > MAX_HOLD)
+        this->current.active = 0;
+
+    //frames are sample_rate / 60 samples long on average, the remainder is spread over the frames
+    this->rate_remainder += this->sample_rate;
+    this->samples_left = this->rate_remainder / 60;
+    this->rate_remainder %= 60;
+
+    double bitsPerSecond = 4000.0 * std::pow(2.0, (this->current.pitch - 64) / 48.0);
+    this->step = (uint64_t)(bitsPerSecond / this->sample_rate * 4294967296.0);
+}
+
+void VChip8AudioSynth::synthesize(int16_t* out, size_t count){
+    if (!this->current.active){
+        std::memset(out, 0, count * sizeof(int16_t));
+        return;
+    }
+    //the phase keeps running across frames so consecutive beeps join without clicks
+    const uint64_t wrap = PATTERN_BITS << 32;
+    for (size_t i = 0; i < count; i++){
+        unsigned int bit = (unsigned int)(this->phase >> 32);
+        bool high = (this->current.pattern[bit / 8] >> (7 - bit % 8)) & 1u;
+        out[i] = high ? this->amplitude : (int16_t)-this->amplitude;
+        this->phase = (this->phase + this->step) % wrap;
+    }
+}
+
+void VChip8AudioSynth::render(int16_t* out, size_t count){
+    while (count > 0){
+        if (this->samples_left == 0)
+            next_frame();
+        size_t n = count < this->samples_left ? count : this->samples_left;
+        synthesize(out, n);
+        out += n;
+        count -= n;
+        this->samples_left -= n;
+    }
+}
+
+size_t VChip8AudioSynth::render_frame(int16_t* out){
+    next_frame();
+    size_t n = this->samples_left;
+    synthesize(out, n);
+    this->samples_left = 0;
+    return n;
+}
+
+VChip8WavFile::~VChip8WavFile(){
+    close();
+}
+
+bool VChip8WavFile::open(const char* file_path, unsigned int sample_rate){
+    this->file.open(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!this->file.is_open())
+        return false;
+    this->data_bytes = 0;
+
+    //RIFF header of a 16-bit mono PCM file, both sizes are patched in by close()
+    this->file.write("RIFF", 4);
+    put(this->file, 0, 4);
+    this->file.write("WAVEfmt ", 8);
+    put(this->file, 16, 4);
+    put(this->file, 1, 2);                  //PCM
+    put(this->file, 1, 2);                  //mono
+    put(this->file, sample_rate, 4);
+    put(this->file, sample_rate * 2, 4);    //bytes per second
+    put(this->file, 2, 2);                  //bytes per sample
+    put(this->file, 16, 2);
+    this->file.write("data", 4);
+    put(this->file, 0, 4);
+    return this->file.good();
+}
+
+void VChip8WavFile::write(const int16_t* samples, size_t count){
+    //little endian whatever the host, converted in chunks so a frame is a couple of stream writes
+    char bytes[1024];
+    for (size_t i = 0; i < count; ){
+        size_t n = 0;
+        for (; i < count && n < sizeof(bytes); i++){
+            bytes[n++] = (char)((uint16_t)samples[i] & 0xFFu);
+            bytes[n++] = (char)((uint16_t)samples[i] >> 8);
+        }
+        this->file.write(bytes, n);
+    }
+    this->data_bytes += count * 2;
+}
+
+bool VChip8WavFile::close(){
+    if (!this->file.is_open())
+        return true;
+    //sizes past 4GB can't be expressed, the header then claims the maximum
+    uint32_t dataSize = this->data_bytes > 0xFFFFFFFFull - 36 ? 0xFFFFFFFFu - 36 : (uint32_t)this->data_bytes;
+    this->file.seekp(4);
+    put(this->file, 36 + dataSize, 4);
+    this->file.seekp(40);
+    put(this->file, dataSize, 4);
+    bool good = this->file.good();
+    this->file.close();
+    return good;
+}
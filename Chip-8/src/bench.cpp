@@ -0,0 +1,327 @@
+#include "../include/chip_8.hpp"
+#include "../include/jit.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Benchmark suite: per-opcode micro-benchmarks of every OP_* handler and whole-ROM macro-benchmarks
+//over synthetic ROMs, results are printed as JSON for tracking regressions between releases.
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct MicroResult{
+        std::string name;
+        uint64_t iterations;
+        double ns_per_op;
+    };
+
+    struct MacroResult{
+        std::string name;
+        std::string engine;
+        uint64_t instructions;
+        uint64_t frames;
+        double seconds;
+    };
+
+    //one handler benchmark, the opcode is decoded once and its handler called in a loop
+    struct MicroCase{
+        const char* name;
+        uint16_t opcode;
+        bool stack; //2nnn/00EE, the stack pointer is reset before every call
+        VChip8::Mode mode = VChip8::MODE_CHIP8;
+        bool hires = false;
+        uint8_t planes = 1; //XO-CHIP plane mask
+        bool exits = false; //00FD, the error code is cleared before every call
+    };
+
+    const MicroCase micro_cases[] = {
+        { "OP_00E0", 0x00E0, false },
+        { "OP_00EE", 0x00EE, true },
+        { "OP_1nnn", 0x1300, false },
+        { "OP_2nnn", 0x2300, true },
+        { "OP_3xkk", 0x3142, false },
+        { "OP_4xkk", 0x4142, false },
+        { "OP_5xy0", 0x5120, false },
+        { "OP_6xkk", 0x6142, false },
+        { "OP_7xkk", 0x7103, false },
+        { "OP_8xy0", 0x8120, false },
+        { "OP_8xy1", 0x8121, false },
+        { "OP_8xy2", 0x8122, false },
+        { "OP_8xy3", 0x8123, false },
+        { "OP_8xy4", 0x8124, false },
+        { "OP_8xy5", 0x8125, false },
+        { "OP_8xy6", 0x8126, false },
+        { "OP_8xy7", 0x8127, false },
+        { "OP_8xyE", 0x812E, false },
+        { "OP_9xy0", 0x9120, false },
+        { "OP_Annn", 0xA300, false },
+        { "OP_Bnnn", 0xB300, false },
+        { "OP_Cxkk", 0xC1FF, false },
+        { "OP_Dxyn/inside", 0xDAB5, false },   //VA, VB = 8, 8
+        { "OP_Dxyn/edge", 0xDCD5, false },     //VC, VD = 60, 30, clipped right and bottom
+        { "OP_Dxyn/tall", 0xDABF, false },     //15 rows
+        { "OP_Ex9E", 0xE59E, false },
+        { "OP_ExA1", 0xE5A1, false },
+        { "OP_Fx07", 0xF107, false },
+        { "OP_Fx0A", 0xF50A, false },          //key 5 is held, never waits
+        { "OP_Fx15", 0xF115, false },
+        { "OP_Fx18", 0xF118, false },
+        { "OP_Fx1E", 0xF11E, false },
+        { "OP_Fx29", 0xF129, false },
+        { "OP_Fx33", 0xF133, false },
+        { "OP_Fx55", 0xF755, false },
+        { "OP_Fx65", 0xF765, false },
+        { "OP_00Cn/hires", 0x00C4, false, VChip8::MODE_SCHIP, true },
+        { "OP_00FB/hires", 0x00FB, false, VChip8::MODE_SCHIP, true },
+        { "OP_00FC/hires", 0x00FC, false, VChip8::MODE_SCHIP, true },
+        { "OP_00Dn/hires", 0x00D4, false, VChip8::MODE_XOCHIP, true },
+        { "OP_00FD", 0x00FD, false, VChip8::MODE_SCHIP, false, 1, true },
+        { "OP_00FE", 0x00FE, false, VChip8::MODE_SCHIP, true },
+        { "OP_00FF", 0x00FF, false, VChip8::MODE_SCHIP },
+        { "OP_Dxyn/hires", 0xDAB5, false, VChip8::MODE_SCHIP, true },
+        { "OP_Dxyn/hires-16x16", 0xDCD0, false, VChip8::MODE_SCHIP, true }, //straddles the two words of a row
+        { "OP_Dxyn/planes", 0xDAB5, false, VChip8::MODE_XOCHIP, false, 3 },
+        { "OP_Fx30", 0xF130, false, VChip8::MODE_SCHIP },
+        { "OP_Fx75", 0xF775, false, VChip8::MODE_SCHIP },
+        { "OP_Fx85", 0xF785, false, VChip8::MODE_SCHIP },
+        { "OP_5xy2", 0x5072, false, VChip8::MODE_XOCHIP },
+        { "OP_5xy3", 0x5073, false, VChip8::MODE_XOCHIP },
+        { "OP_F000", 0xF000, false, VChip8::MODE_XOCHIP },     //reads the word after it, see the program counter reset
+        { "OP_Fn01", 0xF201, false, VChip8::MODE_XOCHIP },
+        { "OP_F002", 0xF002, false, VChip8::MODE_XOCHIP },
+        { "OP_Fx3A", 0xF13A, false, VChip8::MODE_XOCHIP },
+    };
+
+    void prepare(VChip8& chip8){
+        for (unsigned int r = 0; r < 16; r++)
+            chip8.registers[r] = (uint8_t)(r * 17 + 3);
+        chip8.registers[0xA] = 8;
+        chip8.registers[0xB] = 8;
+        chip8.registers[0xC] = 60;
+        chip8.registers[0xD] = 30;
+        chip8.registers[0x5] = 5;
+        chip8.keypad[5] = 1;
+        chip8.index_register = 0x300;
+    }
+
+    //the machine the handlers run on, lets 00FD's exit be undone between calls
+    struct BenchMachine : VChip8{
+        using VChip8::VChip8;
+
+        void clear_error(){
+            this->error_code = ALL_OKAY;
+        }
+    };
+
+    MicroResult run_micro(const MicroCase& bench, uint64_t iterations){
+        BenchMachine chip8(1);
+        chip8.set_mode(bench.mode);
+        prepare(chip8);
+        chip8.hires = bench.hires;
+        chip8.plane_mask = bench.planes;
+        const VChip8::Instruction instr = chip8.decode(bench.opcode);
+        const VChip8::Chip8Func handler = VChip8::handlers[instr.id];
+        const uint16_t index = chip8.index_register;
+        const uint16_t pc = chip8.program_counter;
+
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++){
+            if (bench.stack)
+                chip8.stack_pointer = 1;
+            if (bench.exits)
+                chip8.clear_error();
+            (chip8.*handler)(instr);
+            //Fx1E and friends walk the index register, F000 and 00FD the program counter, keep them on the same data
+            chip8.index_register = index;
+            chip8.program_counter = pc;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        MicroResult result;
+        result.name = bench.name;
+        result.iterations = iterations;
+        result.ns_per_op = seconds * 1e9 / iterations;
+        return result;
+    }
+
+    //cost of getting a fresh machine, constructing one versus resetting a pooled one
+    MicroResult run_lifecycle(bool pooled, uint64_t iterations){
+        std::unique_ptr<VChip8> pool(new VChip8(1));
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++){
+            if (pooled)
+                pool->reset((uint32_t)i);
+            else
+                pool.reset(new VChip8((uint32_t)i));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        MicroResult result;
+        result.name = pooled ? "VChip8::reset" : "VChip8::VChip8";
+        result.iterations = iterations;
+        result.ns_per_op = seconds * 1e9 / iterations;
+        return result;
+    }
+
+    //synthetic ROMs, every one is an endless loop starting at 0x200
+    struct Rom{
+        const char* name;
+        std::vector<uint8_t> bytes;
+
+        void op(uint16_t opcode){
+            bytes.push_back(opcode >> 8);
+            bytes.push_back(opcode & 0xFFu);
+        }
+    };
+
+    Rom alu_rom(){
+        //long straight-line arithmetic on all registers
+        Rom rom{ "alu", {} };
+        rom.op(0x6001); rom.op(0x6102); rom.op(0x6203); rom.op(0x6304);
+        for (unsigned int i = 0; i < 8; i++){
+            rom.op(0x7011); rom.op(0x8014); rom.op(0x8125); rom.op(0x8232);
+            rom.op(0x8301); rom.op(0x8016); rom.op(0x811E); rom.op(0x8237);
+            rom.op(0x8303); rom.op(0x7105); rom.op(0xF01E); rom.op(0x8214);
+        }
+        rom.op(0x1208);
+        return rom;
+    }
+
+    Rom draw_rom(){
+        //sprites all over the screen, including the clipped edges, and a clear every pass
+        Rom rom{ "draw", {} };
+        rom.op(0x00E0);
+        rom.op(0x6000); rom.op(0x6100); rom.op(0x6200);   //x, y, digit
+        rom.op(0x630F);
+        //loop at 0x20A:
+        rom.op(0xF229);                                   //I = font digit V2
+        rom.op(0xD015);
+        rom.op(0x7007); rom.op(0x7105); rom.op(0x7201);
+        rom.op(0x8232);                                   //V2 &= 0x0F
+        rom.op(0xA2F0);
+        rom.op(0xD01F);                                   //tall sprite from ROM data
+        rom.op(0x4000); rom.op(0x00E0);                   //clear when x wrapped to 0
+        rom.op(0x120A);
+        rom.bytes.resize(0xF0, 0);
+        for (unsigned int i = 0; i < 16; i++)
+            rom.bytes.push_back((uint8_t)(0x81 | (i << 3)));
+        return rom;
+    }
+
+    Rom branch_rom(){
+        //skips, calls and returns with short blocks in between
+        Rom rom{ "branch", {} };
+        rom.op(0x6000); rom.op(0x6100);
+        //loop at 0x204:
+        rom.op(0x7001);
+        rom.op(0x3000); rom.op(0x7101);
+        rom.op(0x4080); rom.op(0x2230);
+        rom.op(0x5010); rom.op(0x7102);
+        rom.op(0x9010); rom.op(0x2234);
+        rom.op(0x8106);
+        rom.op(0x1204);
+        rom.bytes.resize(0x30, 0);
+        //0x230:
+        rom.op(0x7203); rom.op(0x00EE);
+        //0x234:
+        rom.op(0x8324); rom.op(0x00EE);
+        return rom;
+    }
+
+    MacroResult run_macro(const Rom& rom, bool useJit, uint64_t instructions, unsigned int instructionsPerFrame){
+        VChip8 chip8(1);
+        std::memcpy(chip8.memory + 0x200, rom.bytes.data(), rom.bytes.size());
+        chip8.flush_code_cache();
+        VChip8Jit jit(chip8);
+
+        MacroResult result;
+        result.name = rom.name;
+        result.engine = useJit ? "jit" : "interpreter";
+        result.instructions = 0;
+        result.frames = 0;
+
+        auto start = Clock::now();
+        while (result.instructions < instructions && chip8.get_error_code() == VChip8::ALL_OKAY){
+            result.instructions += useJit ? jit.run_frame(instructionsPerFrame) : chip8.run_frame(instructionsPerFrame);
+            ++result.frames;
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return result;
+    }
+
+    void usage(const char* program){
+        std::fprintf(stderr, "Usage: %s [--quick] [--output FILE]\n"
+                             "  --quick        fewer iterations, for smoke runs\n"
+                             "  --output FILE  write the JSON report to FILE instead of stdout\n", program);
+        std::exit(EXIT_FAILURE);
+    }
+
+}
+
+int main(int argc, char** argv){
+
+    bool quick = false;
+    const char* outputFilename = nullptr;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputFilename = argv[++i];
+        else
+            usage(argv[0]);
+    }
+
+    const uint64_t microIterations = quick ? 200000ull : 5000000ull;
+    const uint64_t macroInstructions = quick ? 2000000ull : 100000000ull;
+    const unsigned int instructionsPerFrame = 1000;
+
+    std::vector<MicroResult> micro;
+    for (const MicroCase& bench : micro_cases)
+        micro.push_back(run_micro(bench, microIterations));
+    micro.push_back(run_lifecycle(false, microIterations / 10));
+    micro.push_back(run_lifecycle(true, microIterations / 10));
+
+    std::vector<MacroResult> macro;
+    const Rom roms[] = { alu_rom(), draw_rom(), branch_rom() };
+    VChip8 probe;
+    bool jitAvailable = VChip8Jit(probe).available();
+    for (const Rom& rom : roms){
+        macro.push_back(run_macro(rom, false, macroInstructions, instructionsPerFrame));
+        if (jitAvailable)
+            macro.push_back(run_macro(rom, true, macroInstructions, instructionsPerFrame));
+    }
+
+    FILE* out = outputFilename ? std::fopen(outputFilename, "w") : stdout;
+    if (!out){
+        std::fprintf(stderr, "Couldn't write %s\n", outputFilename);
+        return -1;
+    }
+
+    std::fprintf(out, "{\n  \"instructions_per_frame\": %u,\n  \"micro\": [\n", instructionsPerFrame);
+    for (size_t i = 0; i < micro.size(); i++){
+        std::fprintf(out, "    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f }%s\n",
+                     micro[i].name.c_str(), (unsigned long long)micro[i].iterations, micro[i].ns_per_op,
+                     i + 1 < micro.size() ? "," : "");
+    }
+    std::fprintf(out, "  ],\n  \"macro\": [\n");
+    for (size_t i = 0; i < macro.size(); i++){
+        const MacroResult& m = macro[i];
+        double seconds = m.seconds > 0 ? m.seconds : 1e-9;
+        std::fprintf(out, "    { \"name\": \"%s\", \"engine\": \"%s\", \"instructions\": %llu, \"frames\": %llu, "
+                          "\"seconds\": %.6f, \"mips\": %.3f, \"frames_per_sec\": %.1f, \"ns_per_instruction\": %.3f }%s\n",
+                     m.name.c_str(), m.engine.c_str(), (unsigned long long)m.instructions, (unsigned long long)m.frames,
+                     m.seconds, m.instructions / seconds / 1e6, m.frames / seconds,
+                     m.instructions ? m.seconds * 1e9 / m.instructions : 0.0, i + 1 < macro.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,378 @@
+#include "../include/capture.hpp"
+#include "../include/video.hpp"
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+    //XO-CHIP plane colours, as shown by VChip8
+    const uint32_t PLANE_PALETTE[4] = { PIXEL_OFF, PIXEL_ON, 0xAAAAAAFFu, 0x555555FFu };
+
+    uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0){
+        static const std::array<uint32_t, 256> table = []{
+            std::array<uint32_t, 256> entries{};
+            for (uint32_t n = 0; n < 256; n++){
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void put32(std::vector<uint8_t>& out, uint32_t value){
+        out.push_back(value >> 24);
+        out.push_back((value >> 16) & 0xFFu);
+        out.push_back((value >> 8) & 0xFFu);
+        out.push_back(value & 0xFFu);
+    }
+
+    //an image sequence pattern may hold at most one integer conversion (flags and width allowed) and "%%"
+    bool valid_pattern(const char* pattern){
+        unsigned int conversions = 0;
+        for (const char* c = pattern; *c; c++){
+            if (*c != '%')
+                continue;
+            if (*++c == '%')
+                continue;
+            while (*c == '0' || *c == '-' || *c == ' ' || *c == '+')
+                c++;
+            while (std::isdigit((unsigned char)*c))
+                c++;
+            if (*c != 'u' && *c != 'd')
+                return false;
+            ++conversions;
+        }
+        return conversions <= 1;
+    }
+
+    //appends a PNG chunk, its length, type, data and CRC
+    void put_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size){
+        put32(out, (uint32_t)size);
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        put32(out, crc32(out.data() + start, size + 4));
+    }
+
+}
+
+VChip8Capture::~VChip8Capture(){
+    close();
+}
+
+bool VChip8Capture::parse_format(const char* name, Format& format){
+    if (std::strcmp(name, "raw") == 0)
+        format = FORMAT_RAW;
+    else if (std::strcmp(name, "y4m") == 0)
+        format = FORMAT_Y4M;
+    else if (std::strcmp(name, "png") == 0)
+        format = FORMAT_PNG;
+    else
+        return false;
+    return true;
+}
+
+VChip8Capture::Format VChip8Capture::format_for(const char* file_path){
+    const char* extension = std::strrchr(file_path, '.');
+    if (extension && std::strcmp(extension, ".png") == 0)
+        return FORMAT_PNG;
+    if (extension && (std::strcmp(extension, ".raw") == 0 || std::strcmp(extension, ".rgba") == 0))
+        return FORMAT_RAW;
+    return FORMAT_Y4M;
+}
+
+bool VChip8Capture::parse_scaler(const char* name, Scaler& scaler, unsigned int& factor){
+    if (std::strcmp(name, "epx") == 0){
+        scaler = SCALER_EPX;
+        factor = 2;
+        return true;
+    }
+    const char* colon = std::strchr(name, ':');
+    size_t length = colon ? (size_t)(colon - name) : std::strlen(name);
+    if (length == 7 && std::strncmp(name, "nearest", 7) == 0)
+        scaler = SCALER_NEAREST;
+    else if (length == 9 && std::strncmp(name, "scanlines", 9) == 0)
+        scaler = SCALER_SCANLINES;
+    else
+        return false;
+    factor = colon ? (unsigned int)std::strtoul(colon + 1, nullptr, 10) : 2;
+    return factor >= (scaler == SCALER_SCANLINES ? 2u : 1u) && factor <= 32;
+}
+
+unsigned int VChip8Capture::output_width() const{
+    return this->base_width * this->options.factor;
+}
+
+unsigned int VChip8Capture::output_height() const{
+    return this->base_height * this->options.factor;
+}
+
+uint64_t VChip8Capture::written() const{
+    return this->written_count.load(std::memory_order_relaxed);
+}
+
+uint64_t VChip8Capture::duplicates() const{
+    return this->duplicate_count;
+}
+
+uint64_t VChip8Capture::dropped() const{
+    return this->dropped_count;
+}
+
+bool VChip8Capture::open(const char* file_path, const Options& options){
+    close();
+    this->options = options;
+    if (this->options.scaler == SCALER_EPX)
+        this->options.factor = 2;
+    if (this->options.factor == 0)
+        this->options.factor = 1;
+    this->path = file_path;
+    this->base_width = options.mode == VChip8::MODE_CHIP8 ? 64 : 128;
+    this->base_height = options.mode == VChip8::MODE_CHIP8 ? 32 : 64;
+
+    //image sequences open a file per frame
+    if (options.format == FORMAT_PNG && !valid_pattern(file_path))
+        return false;
+    if (options.format != FORMAT_PNG){
+        this->output = std::strcmp(file_path, "-") == 0 ? stdout : std::fopen(file_path, "wb");
+        if (!this->output)
+            return false;
+        if (options.format == FORMAT_Y4M)
+            std::fprintf(this->output, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n", output_width(), output_height());
+    }
+
+    this->base.assign((size_t)this->base_width * this->base_height, 0);
+    this->lores.assign(64 * 32, 0);
+    this->scaled.assign((size_t)output_width() * output_height(), 0);
+    this->queue.assign(CAPACITY, Entry{});
+    this->head.store(0);
+    this->tail.store(0);
+    this->closing.store(false);
+    this->has_last = false;
+    this->duplicate_count = 0;
+    this->dropped_count = 0;
+    this->written_count.store(0);
+    this->failed = false;
+    this->running = true;
+    this->worker = std::thread(&VChip8Capture::run, this);
+    return true;
+}
+
+void VChip8Capture::submit(const VChip8Machine& chip8, uint64_t frame_number){
+    if (!this->running)
+        return;
+
+    //a still screen costs a memcmp and a queue slot, not an expand and an encode
+    VChip8Frame frame;
+    frame.capture(chip8, frame_number);
+    if (this->options.dedupe && this->has_last && frame.hires == this->last.hires &&
+        std::memcmp(frame.video_memory, this->last.video_memory, sizeof(frame.video_memory)) == 0){
+        ++this->duplicate_count;
+        //a stream has a fixed frame rate and no timestamps, leaving the frame out would shorten it
+        if (this->options.format != FORMAT_PNG && !enqueue(nullptr))
+            ++this->dropped_count;
+        return;
+    }
+    //a hi-res frame doesn't fit a sink opened for CHIP-8
+    if (frame.hires && this->base_width < 128){
+        ++this->dropped_count;
+        return;
+    }
+
+    if (!enqueue(&frame)){
+        ++this->dropped_count;
+        return;
+    }
+    this->last = frame;
+    this->has_last = true;
+}
+
+bool VChip8Capture::enqueue(const VChip8Frame* frame){
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    while (tail - this->head.load(std::memory_order_acquire) == CAPACITY){
+        if (!this->options.block_when_full)
+            return false;
+        std::this_thread::yield();
+    }
+    Entry& entry = this->queue[tail % CAPACITY];
+    entry.repeat = frame == nullptr;
+    if (frame)
+        entry.frame = *frame;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void VChip8Capture::run(){
+    for (;;){
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head == this->tail.load(std::memory_order_acquire)){
+            //closing is set after the last submit, so an empty queue seen after it stays empty
+            if (this->closing.load(std::memory_order_acquire) && head == this->tail.load(std::memory_order_acquire))
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const Entry& entry = this->queue[head % CAPACITY];
+        if (entry.repeat)
+            repeat();
+        else
+            encode(entry.frame);
+        this->head.store(head + 1, std::memory_order_release);
+    }
+}
+
+void VChip8Capture::encode(const VChip8Frame& frame){
+    //expand to the mode's base size, lo-res frames of the hi-res modes are doubled first
+    bool xo = frame.mode == VChip8::MODE_XOCHIP;
+    unsigned int words = frame.hires ? 128 : 32;
+    uint32_t* target = (this->base_width == 128 && !frame.hires) ? this->lores.data() : this->base.data();
+    if (xo)
+        expand_planes(frame.video_memory, frame.video_memory + VChip8::PLANE_WORDS, words, target, PLANE_PALETTE);
+    else
+        expand_pixels(frame.video_memory, words, target);
+    if (target == this->lores.data())
+        scale_nearest(this->lores.data(), 64, 32, 2, this->base.data());
+
+    switch (this->options.scaler){
+    case SCALER_EPX:
+        scale_epx(this->base.data(), this->base_width, this->base_height, this->scaled.data());
+        break;
+    case SCALER_SCANLINES:
+        scale_scanlines(this->base.data(), this->base_width, this->base_height, this->options.factor, this->scaled.data());
+        break;
+    default:
+        scale_nearest(this->base.data(), this->base_width, this->base_height, this->options.factor, this->scaled.data());
+        break;
+    }
+
+    switch (this->options.format){
+    case FORMAT_RAW:
+        write_raw();
+        break;
+    case FORMAT_Y4M:
+        write_y4m();
+        break;
+    case FORMAT_PNG:
+        this->failed |= !write_png(frame.number);
+        break;
+    }
+    this->written_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VChip8Capture::repeat(){
+    //raw and y4m frames are written whole from bytes, which still holds the previous one
+    this->failed |= std::fwrite(this->bytes.data(), 1, this->bytes.size(), this->output) != this->bytes.size();
+    this->written_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VChip8Capture::write_raw(){
+    this->bytes.resize(this->scaled.size() * 4);
+    uint8_t* out = this->bytes.data();
+    for (uint32_t pixel : this->scaled){
+        *out++ = pixel >> 24;
+        *out++ = (pixel >> 16) & 0xFFu;
+        *out++ = (pixel >> 8) & 0xFFu;
+        *out++ = 0xFFu;
+    }
+    this->failed |= std::fwrite(this->bytes.data(), 1, this->bytes.size(), this->output) != this->bytes.size();
+}
+
+void VChip8Capture::write_y4m(){
+    //planar Y, U, V after the frame header
+    size_t pixels = this->scaled.size();
+    this->bytes.resize(6 + 3 * pixels);
+    std::memcpy(this->bytes.data(), "FRAME\n", 6);
+    uint8_t* y = this->bytes.data() + 6;
+    uint8_t* u = y + pixels;
+    uint8_t* v = u + pixels;
+    for (size_t i = 0; i < pixels; i++){
+        int r = this->scaled[i] >> 24, g = (this->scaled[i] >> 16) & 0xFF, b = (this->scaled[i] >> 8) & 0xFF;
+        y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    this->failed |= std::fwrite(this->bytes.data(), 1, this->bytes.size(), this->output) != this->bytes.size();
+}
+
+bool VChip8Capture::write_png(uint64_t number){
+    char name[1024];
+    std::snprintf(name, sizeof(name), this->path.c_str(), (unsigned int)number);
+    unsigned int width = output_width(), height = output_height();
+
+    //raw scanlines, filter byte 0 then RGBA
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)height * (1 + 4 * width));
+    for (unsigned int row = 0; row < height; row++){
+        raw.push_back(0);
+        for (unsigned int x = 0; x < width; x++){
+            uint32_t pixel = this->scaled[(size_t)row * width + x];
+            raw.push_back(pixel >> 24);
+            raw.push_back((pixel >> 16) & 0xFFu);
+            raw.push_back((pixel >> 8) & 0xFFu);
+            raw.push_back(0xFFu);
+        }
+    }
+
+    //zlib stream of stored deflate blocks, up to 65535 bytes each
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    for (size_t offset = 0; offset < raw.size() || offset == 0; ){
+        size_t length = raw.size() - offset < 0xFFFF ? raw.size() - offset : 0xFFFF;
+        bool final = offset + length == raw.size();
+        zlib.push_back(final ? 1 : 0);
+        zlib.push_back(length & 0xFFu);
+        zlib.push_back(length >> 8);
+        zlib.push_back(~length & 0xFFu);
+        zlib.push_back((~length >> 8) & 0xFFu);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+        if (final)
+            break;
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw){
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t header[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0   //8-bit RGBA, no interlace
+    };
+    put_chunk(png, "IHDR", header, sizeof(header));
+    put_chunk(png, "IDAT", zlib.data(), zlib.size());
+    put_chunk(png, "IEND", nullptr, 0);
+
+    FILE* file = std::fopen(name, "wb");
+    if (!file)
+        return false;
+    bool good = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+    return std::fclose(file) == 0 && good;
+}
+
+bool VChip8Capture::close(){
+    if (!this->running)
+        return true;
+    this->closing.store(true, std::memory_order_release);
+    this->worker.join();
+    this->running = false;
+    if (this->output){
+        if (this->output == stdout)
+            this->failed |= std::fflush(this->output) != 0;
+        else
+            this->failed |= std::fclose(this->output) != 0;
+        this->output = nullptr;
+    }
+    return !this->failed;
+}
@@ -1,215 +1,498 @@
 #include "../include/chip_8.hpp"
+#include "../include/rom_cache.hpp"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <cstring>
 
-VChip8::VChip8(){
-    //initialization
-    this->randGen = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
+#ifdef VCHIP8_PROFILE
+#define PROFILE_INSTRUCTION(instr, pc) (++this->profile.opcode_counts[(instr).id], ++this->profile.pc_counts[(pc) & this->address_mask])
+#else
+#define PROFILE_INSTRUCTION(instr, pc) ((void)0)
+#endif
+
+VChip8Machine::VChip8Machine() : VChip8Machine((uint32_t)std::chrono::system_clock::now().time_since_epoch().count()){
+}
+
+VChip8Machine::VChip8Machine(uint32_t seed){
+    //initialization, the decode tables and font are static so this only touches the machine state
+    this->randGen = std::default_random_engine(seed);
     this->randByte = std::uniform_int_distribution<uint8_t>(0, 255u); 
 
     this->program_counter =  this->ROM_MEM;
 
 	this->error_code = ALL_OKAY;
     loadFontSet();
+}
 
-    //setting up function tables
-    this->table[0x0] = (&VChip8::Table0);
-	this->table[0x1] = (&VChip8::OP_1nnn);
-	this->table[0x2] = (&VChip8::OP_2nnn);
-	this->table[0x3] = (&VChip8::OP_3xkk);
-	this->table[0x4] = (&VChip8::OP_4xkk);
-	this->table[0x5] = (&VChip8::OP_5xy0);
-	this->table[0x6] = (&VChip8::OP_6xkk);
-	this->table[0x7] = (&VChip8::OP_7xkk);
-	this->table[0x8] = (&VChip8::Table8);
-	this->table[0x9] = (&VChip8::OP_9xy0);
-	this->table[0xA] = (&VChip8::OP_Annn);
-	this->table[0xB] = (&VChip8::OP_Bnnn);
-	this->table[0xC] = (&VChip8::OP_Cxkk);
-	this->table[0xD] = (&VChip8::OP_Dxyn);
-	this->table[0xE] = (&VChip8::TableE);
-	this->table[0xF] = (&VChip8::TableF);
-
-	for (size_t i = 0; i <= 0xE; i++)
-	{
-		table0[i] = &VChip8::OP_NULL;
-		table8[i] = &VChip8::OP_NULL;
-		tableE[i] = &VChip8::OP_NULL;
-	}
-	table0[0x0] = &VChip8::OP_00E0;
-	table0[0xE] = &VChip8::OP_00EE;
-	table8[0x0] = &VChip8::OP_8xy0;
-	table8[0x1] = &VChip8::OP_8xy1;
-	table8[0x2] = &VChip8::OP_8xy2;
-	table8[0x3] = &VChip8::OP_8xy3;
-	table8[0x4] = &VChip8::OP_8xy4;
-	table8[0x5] = &VChip8::OP_8xy5;
-	table8[0x6] = &VChip8::OP_8xy6;
-	table8[0x7] = &VChip8::OP_8xy7;
-	table8[0xE] = &VChip8::OP_8xyE;
-	tableE[0x1] = &VChip8::OP_ExA1;
-	tableE[0xE] = &VChip8::OP_Ex9E;
-	for (size_t i = 0; i <= 0x65; i++)
-	{
-		tableF[i] = &VChip8::OP_NULL;
-	}
-	tableF[0x07] = &VChip8::OP_Fx07;
-	tableF[0x0A] = &VChip8::OP_Fx0A;
-	tableF[0x15] = &VChip8::OP_Fx15;
-	tableF[0x18] = &VChip8::OP_Fx18;
-	tableF[0x1E] = &VChip8::OP_Fx1E;
-	tableF[0x29] = &VChip8::OP_Fx29;
-	tableF[0x33] = &VChip8::OP_Fx33;
-	tableF[0x55] = &VChip8::OP_Fx55;
-	tableF[0x65] = &VChip8::OP_Fx65;
-	
+void VChip8Machine::reset(uint32_t seed){
+    this->randGen.seed(seed);
+    this->randByte.reset();
+
+    //memory past memory_size() is never written, see set_mode
+    memset(this->registers, 0, sizeof(this->registers));
+    memset(this->memory, 0, memory_size());
+    memset(this->keypad, 0, sizeof(this->keypad));
+    memset(this->stack, 0, sizeof(this->stack));
+    memset(this->video_memory, 0, sizeof(this->video_memory));
+    memset(this->audio_pattern, 0, sizeof(this->audio_pattern));
+    this->hires = false;
+    this->plane_mask = 1;
+    this->pitch = 64;
+    this->index_register = 0;
+    this->program_counter = this->ROM_MEM;
+    this->stack_pointer = 0;
+    this->delay_timer = 0;
+    this->sound_timer = 0;
+    this->error_code = ALL_OKAY;
+    this->halted = false;
+    this->undefined_addresses.clear();
+    this->undefined_overflow = false;
+    loadFontSet();
+
+    flush_code_cache();
+    this->draw_flag = false;
+    mark_dirty_rows(0, this->VIDEO_HEIGHT);
+}
+
+void VChip8Machine::set_mode(Mode mode){
+    this->mode = mode;
+    this->address_mask = (mode == MODE_XOCHIP) ? 0xFFFFu : 0xFFFu;
+
+    //outside XO-CHIP addresses wrap at 4K, the rest stays zeroed so reset() and snapshots are exact
+    if (mode != MODE_XOCHIP)
+        memset(this->memory + 0x1000, 0, MEMORY_SIZE - 0x1000);
+    memset(this->memory + BIG_FONT_MEM, 0, BIG_FONT_SET_SIZE);
+    loadFontSet();
+
+    memset(this->video_memory, 0, sizeof(this->video_memory));
+    this->hires = false;
+    this->plane_mask = 1;
+
+    //the same bytes decode differently now
+    flush_code_cache();
+    this->draw_flag = false;
+    mark_dirty_rows(0, this->VIDEO_HEIGHT);
+}
+
+bool VChip8Machine::parse_mode(const char* name, Mode& mode){
+    static const char* const names[MODE_COUNT] = { "chip8", "schip", "xochip" };
+    for (unsigned int m = 0; m < MODE_COUNT; m++){
+        if (std::strcmp(name, names[m]) == 0){
+            mode = (Mode)m;
+            return true;
+        }
+    }
+    return false;
 }
 
-void VChip8::loadFontSet(){
-    for (unsigned int i = 0; i < this->FONT_SET_SIZE; i++){
-        this->memory[this->FONT_MEM + i] = this->font_set[i];
+namespace {
+
+    constexpr VChip8Machine::DecodeTables build_decode_tables(VChip8Machine::Mode mode){
+        //every entry not set here stays ID_NULL (0)
+        VChip8Machine::DecodeTables tables{};
+        tables.table[0x1] = VChip8Machine::ID_1nnn;
+        tables.table[0x2] = VChip8Machine::ID_2nnn;
+        tables.table[0x3] = VChip8Machine::ID_3xkk;
+        tables.table[0x4] = VChip8Machine::ID_4xkk;
+        tables.table[0x6] = VChip8Machine::ID_6xkk;
+        tables.table[0x7] = VChip8Machine::ID_7xkk;
+        tables.table[0x9] = VChip8Machine::ID_9xy0;
+        tables.table[0xA] = VChip8Machine::ID_Annn;
+        tables.table[0xB] = VChip8Machine::ID_Bnnn;
+        tables.table[0xC] = VChip8Machine::ID_Cxkk;
+        tables.table[0xD] = VChip8Machine::ID_Dxyn;
+
+        tables.table8[0x0] = VChip8Machine::ID_8xy0;
+        tables.table8[0x1] = VChip8Machine::ID_8xy1;
+        tables.table8[0x2] = VChip8Machine::ID_8xy2;
+        tables.table8[0x3] = VChip8Machine::ID_8xy3;
+        tables.table8[0x4] = VChip8Machine::ID_8xy4;
+        tables.table8[0x5] = VChip8Machine::ID_8xy5;
+        tables.table8[0x6] = VChip8Machine::ID_8xy6;
+        tables.table8[0x7] = VChip8Machine::ID_8xy7;
+        tables.table8[0xE] = VChip8Machine::ID_8xyE;
+        tables.tableE[0x1] = VChip8Machine::ID_ExA1;
+        tables.tableE[0xE] = VChip8Machine::ID_Ex9E;
+
+        tables.tableF[0x07] = VChip8Machine::ID_Fx07;
+        tables.tableF[0x0A] = VChip8Machine::ID_Fx0A;
+        tables.tableF[0x15] = VChip8Machine::ID_Fx15;
+        tables.tableF[0x18] = VChip8Machine::ID_Fx18;
+        tables.tableF[0x1E] = VChip8Machine::ID_Fx1E;
+        tables.tableF[0x29] = VChip8Machine::ID_Fx29;
+        tables.tableF[0x33] = VChip8Machine::ID_Fx33;
+        tables.tableF[0x55] = VChip8Machine::ID_Fx55;
+        tables.tableF[0x65] = VChip8Machine::ID_Fx65;
+
+        if (mode == VChip8Machine::MODE_CHIP8){
+            //00E0 and 00EE are told apart by the last nibble alone, as they always have been
+            for (unsigned int kk = 0; kk <= 0xFF; kk++){
+                if ((kk & 0xF) == 0x0)
+                    tables.table0[kk] = VChip8Machine::ID_00E0;
+                else if ((kk & 0xF) == 0xE)
+                    tables.table0[kk] = VChip8Machine::ID_00EE;
+            }
+            for (unsigned int n = 0; n <= 0xF; n++)
+                tables.table5[n] = VChip8Machine::ID_5xy0;
+            return tables;
+        }
+
+        tables.strict0 = true;
+        tables.table0[0xE0] = VChip8Machine::ID_00E0;
+        tables.table0[0xEE] = VChip8Machine::ID_00EE;
+        for (unsigned int n = 0; n <= 0xF; n++)
+            tables.table0[0xC0 + n] = VChip8Machine::ID_00Cn;
+        tables.table0[0xFB] = VChip8Machine::ID_00FB;
+        tables.table0[0xFC] = VChip8Machine::ID_00FC;
+        tables.table0[0xFD] = VChip8Machine::ID_00FD;
+        tables.table0[0xFE] = VChip8Machine::ID_00FE;
+        tables.table0[0xFF] = VChip8Machine::ID_00FF;
+        tables.tableF[0x30] = VChip8Machine::ID_Fx30;
+        tables.tableF[0x75] = VChip8Machine::ID_Fx75;
+        tables.tableF[0x85] = VChip8Machine::ID_Fx85;
+        if (mode == VChip8Machine::MODE_SCHIP){
+            for (unsigned int n = 0; n <= 0xF; n++)
+                tables.table5[n] = VChip8Machine::ID_5xy0;
+            return tables;
+        }
+
+        for (unsigned int n = 0; n <= 0xF; n++)
+            tables.table0[0xD0 + n] = VChip8Machine::ID_00Dn;
+        tables.table5[0x0] = VChip8Machine::ID_5xy0;
+        tables.table5[0x2] = VChip8Machine::ID_5xy2;
+        tables.table5[0x3] = VChip8Machine::ID_5xy3;
+        tables.tableF[0x00] = VChip8Machine::ID_F000;
+        tables.tableF[0x01] = VChip8Machine::ID_Fn01;
+        tables.tableF[0x02] = VChip8Machine::ID_F002;
+        tables.tableF[0x3A] = VChip8Machine::ID_Fx3A;
+        return tables;
+    }
+
+    //instructions that only read memory, the keypad and the delay timer and only write
+    //registers; a loop of nothing else changes no state the timers or the host can see
+    bool reads_only(uint8_t id){
+        switch (id)
+        {
+        case VChip8Machine::ID_1nnn: case VChip8Machine::ID_3xkk: case VChip8Machine::ID_4xkk: case VChip8Machine::ID_5xy0:
+        case VChip8Machine::ID_6xkk: case VChip8Machine::ID_7xkk: case VChip8Machine::ID_8xy0: case VChip8Machine::ID_8xy1:
+        case VChip8Machine::ID_8xy2: case VChip8Machine::ID_8xy3: case VChip8Machine::ID_8xy4: case VChip8Machine::ID_8xy5:
+        case VChip8Machine::ID_8xy6: case VChip8Machine::ID_8xy7: case VChip8Machine::ID_8xyE: case VChip8Machine::ID_9xy0:
+        case VChip8Machine::ID_Annn: case VChip8Machine::ID_Bnnn: case VChip8Machine::ID_Ex9E: case VChip8Machine::ID_ExA1:
+        case VChip8Machine::ID_Fx07: case VChip8Machine::ID_Fx1E: case VChip8Machine::ID_Fx29: case VChip8Machine::ID_Fx65:
+        case VChip8Machine::ID_5xy3: case VChip8Machine::ID_Fx30: case VChip8Machine::ID_Fx85:
+            return true;
+        }
+        return false;
     }
+
+}
+
+//constant-initialized, ready before any static constructor runs
+const VChip8Machine::DecodeTables VChip8Machine::decode_tables[VChip8Machine::MODE_COUNT] = {
+    build_decode_tables(VChip8Machine::MODE_CHIP8),
+    build_decode_tables(VChip8Machine::MODE_SCHIP),
+    build_decode_tables(VChip8Machine::MODE_XOCHIP)
+};
+
+const uint8_t VChip8Machine::font_set[80] = {
+    //every 1 is a pixel active and 0 is pixel off
+	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0 
+	0x20, 0x60, 0x20, 0x20, 0x70, // 1
+	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+	0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+	0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+	0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+	0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+	0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+	0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+	0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+	0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+	0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+	0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+	0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+	0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+const uint8_t VChip8Machine::big_font_set[160] = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+template<class Quirks, class Bounds>
+const typename VChip8Core<Quirks, Bounds>::Chip8Func VChip8Core<Quirks, Bounds>::handlers[ID_COUNT] = {
+	&VChip8Core::OP_NULL,
+	&VChip8Core::OP_00E0, &VChip8Core::OP_00EE, &VChip8Core::OP_1nnn, &VChip8Core::OP_2nnn,
+	&VChip8Core::OP_3xkk, &VChip8Core::OP_4xkk, &VChip8Core::OP_5xy0, &VChip8Core::OP_6xkk,
+	&VChip8Core::OP_7xkk, &VChip8Core::OP_8xy0, &VChip8Core::OP_8xy1, &VChip8Core::OP_8xy2,
+	&VChip8Core::OP_8xy3, &VChip8Core::OP_8xy4, &VChip8Core::OP_8xy5, &VChip8Core::OP_8xy6,
+	&VChip8Core::OP_8xy7, &VChip8Core::OP_8xyE, &VChip8Core::OP_9xy0, &VChip8Core::OP_Annn,
+	&VChip8Core::OP_Bnnn, &VChip8Core::OP_Cxkk, &VChip8Core::OP_Dxyn, &VChip8Core::OP_Ex9E,
+	&VChip8Core::OP_ExA1, &VChip8Core::OP_Fx07, &VChip8Core::OP_Fx0A, &VChip8Core::OP_Fx15,
+	&VChip8Core::OP_Fx18, &VChip8Core::OP_Fx1E, &VChip8Core::OP_Fx29, &VChip8Core::OP_Fx33,
+	&VChip8Core::OP_Fx55, &VChip8Core::OP_Fx65,
+	&VChip8Core::OP_00Cn, &VChip8Core::OP_00Dn, &VChip8Core::OP_00FB, &VChip8Core::OP_00FC,
+	&VChip8Core::OP_00FD, &VChip8Core::OP_00FE, &VChip8Core::OP_00FF, &VChip8Core::OP_5xy2,
+	&VChip8Core::OP_5xy3, &VChip8Core::OP_F000, &VChip8Core::OP_Fn01, &VChip8Core::OP_F002,
+	&VChip8Core::OP_Fx30, &VChip8Core::OP_Fx3A, &VChip8Core::OP_Fx75, &VChip8Core::OP_Fx85
+};
+
+const char* const VChip8Machine::instr_names[VChip8Machine::ID_COUNT] = {
+	"NULL",
+	"00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk",
+	"7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6",
+	"8xy7", "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E",
+	"ExA1", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33",
+	"Fx55", "Fx65",
+	"00Cn", "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "5xy2",
+	"5xy3", "F000", "Fn01", "F002", "Fx30", "Fx3A", "Fx75", "Fx85"
+};
+
+void VChip8Machine::loadFontSet(){
+    memcpy(this->memory + this->FONT_MEM, this->font_set, this->FONT_SET_SIZE);
+    if (this->mode != MODE_CHIP8)
+        memcpy(this->memory + this->BIG_FONT_MEM, this->big_font_set, this->BIG_FONT_SET_SIZE);
 }
 
-void VChip8::loadRom(const char* file_path){
-    //binary and at the end
-    std::fstream file(file_path, std::ios::in | std::ios::binary | std::ios::ate);
-    if (!file.is_open()){
-        //add error handling/reporting here
+void VChip8Machine::loadRom(const char* file_path){
+    //the file is read once per process, instances of the same ROM share the image
+    std::shared_ptr<const VChip8RomImage> image = VChip8RomCache::shared().open(file_path);
+    if (!image){
 		this->error_code = FILE_NOT_FOUND;
         return ;
     }
-    std::streampos size = file.tellg();
-    std::cerr<<size<<"\n";
-    char* buffer = new char[size];
-    file.seekg(0, std::ios::beg); //reverse to the start
-    file.read(buffer, size);
-    file.close();
-	
-	if (size > (0xFFFu - this->ROM_MEM)){
+    loadRom(image->data(), image->size());
+}
+
+void VChip8Machine::loadRom(const uint8_t* rom, size_t size){
+	if (size > (unsigned int)this->address_mask - this->ROM_MEM){
 		this->error_code = ROM_OVERFLOW;
 		return;
 	}
-    for (long i = 0; i < size; i++){
-        this->memory[this->ROM_MEM +  i] =  buffer[i];
-    }
-    delete [] buffer;
+    std::memcpy(this->memory + this->ROM_MEM, rom, size);
+    flush_code_cache();
 }
 
 
-int VChip8::get_error_code(){
+int VChip8Machine::get_error_code(){
 	return this->error_code;
 }
 
-void VChip8::OP_00E0(){ // - CLS
- //clear the chip's video memory
-  memset(this->video_memory, 0, sizeof(this->video_memory));
+uint64_t VChip8Machine::get_frame_hash(){
+	//64-bit FNV-1a over the displayed words of plane 0 (and plane 1 in XO-CHIP), a CHIP-8
+	//display hashes its 32 rows exactly as it always has
+	size_t words = this->hires ? 2 * this->HIRES_HEIGHT : this->VIDEO_HEIGHT;
+	size_t bytes = words * sizeof(uint64_t);
+	const uint8_t* planes[2] = {
+		reinterpret_cast<const uint8_t*>(this->video_memory),
+		reinterpret_cast<const uint8_t*>(this->video_memory + PLANE_WORDS)
+	};
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (unsigned int p = 0; p < (this->mode == MODE_XOCHIP ? 2u : 1u); p++){
+		for (size_t i = 0; i < bytes; i++){
+			hash ^= planes[p][i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+	if (this->mode != MODE_CHIP8){
+		hash ^= this->hires;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+uint64_t VChip8Machine::get_state_hash() const{
+	//64-bit FNV-1a over a snapshot, covers everything restore() would bring back
+	Snapshot state;
+	snapshot(state);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < sizeof(state); i++){
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void VChip8Machine::snapshot(Snapshot& state) const{
+	memcpy(state.memory, this->memory, sizeof(state.memory));
+	memcpy(state.video_memory, this->video_memory, sizeof(state.video_memory));
+	memcpy(state.stack, this->stack, sizeof(state.stack));
+	memcpy(state.registers, this->registers, sizeof(state.registers));
+	memcpy(state.flag_registers, this->flag_registers, sizeof(state.flag_registers));
+	memcpy(state.audio_pattern, this->audio_pattern, sizeof(state.audio_pattern));
+	state.index_register = this->index_register;
+	state.program_counter = this->program_counter;
+	state.stack_pointer = this->stack_pointer;
+	state.delay_timer = this->delay_timer;
+	state.sound_timer = this->sound_timer;
+	state.error_code = this->error_code;
+	state.mode = this->mode;
+	state.hires = this->hires;
+	state.plane_mask = this->plane_mask;
+	state.pitch = this->pitch;
+	state.halted = this->halted;
+	memset(state.reserved, 0, sizeof(state.reserved));
+	memset(state.random_engine, 0, sizeof(state.random_engine));
+	memcpy(state.random_engine, &this->randGen, sizeof(this->randGen));
+}
+
+void VChip8Machine::restore(const Snapshot& state){
+	memcpy(this->memory, state.memory, sizeof(this->memory));
+	memcpy(this->video_memory, state.video_memory, sizeof(this->video_memory));
+	memcpy(this->stack, state.stack, sizeof(this->stack));
+	memcpy(this->registers, state.registers, sizeof(this->registers));
+	memcpy(this->flag_registers, state.flag_registers, sizeof(this->flag_registers));
+	memcpy(this->audio_pattern, state.audio_pattern, sizeof(this->audio_pattern));
+	this->index_register = state.index_register;
+	this->program_counter = state.program_counter;
+	this->stack_pointer = state.stack_pointer;
+	this->delay_timer = state.delay_timer;
+	this->sound_timer = state.sound_timer;
+	this->error_code = (ErrorCodes)state.error_code;
+	this->mode = (Mode)state.mode;
+	this->address_mask = (this->mode == MODE_XOCHIP) ? 0xFFFFu : 0xFFFu;
+	this->hires = state.hires;
+	this->plane_mask = state.plane_mask;
+	this->pitch = state.pitch;
+	memcpy(&this->randGen, state.random_engine, sizeof(this->randGen));
+	this->halted = state.halted;
+
+	//the restored memory may hold different code, and the whole frame must be presented again
+	flush_code_cache();
+	mark_dirty_rows(0, display_height());
+}
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00E0(const Instruction&){ // - CLS
+ //clear the displayed words of the selected planes, the rest of video memory is always blank
+  size_t words = this->hires ? 2 * this->HIRES_HEIGHT : this->VIDEO_HEIGHT;
+  for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+      if (this->plane_mask & (1u << p))
+          memset(this->video_memory + p * PLANE_WORDS, 0, words * sizeof(uint64_t));
+  }
+  mark_dirty_rows(0, display_height());
 } 
 
-void VChip8::OP_00EE(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00EE(const Instruction&){
     //returns to the location stored in PC
+    if constexpr (Bounds::checked){
+        if (this->stack_pointer == 0){
+            trap(STACK_UNDERFLOW);
+            return;
+        }
+    }
     --this->stack_pointer;
-    this->program_counter = this->stack[this->stack_pointer];
+    this->program_counter = this->stack[this->stack_pointer & 0xFu];
 } // - RET
 
-// void VChip8::OP_0nnn(){
+// void VChip8Machine::OP_0nnn(const Instruction& instr){
 //     //
 // } // - SYS addr
 
-void VChip8::OP_1nnn(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_1nnn(const Instruction& instr){
     //JP addr
-    uint16_t address = OP_MEMORY(this->opcode);
-    this->program_counter= address;
+    this->program_counter = instr.nnn;
 } // - JP addr
 
-void VChip8::OP_2nnn(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_2nnn(const Instruction& instr){
     //CALL addr
-    uint16_t address = OP_MEMORY(this->opcode);
-    this->stack[this->stack_pointer] = this->program_counter;
-    this->program_counter =  address;
+#ifdef VCHIP8_PROFILE
+    ++this->profile.call_counts[instr.nnn];
+#endif
+    if constexpr (Bounds::checked){
+        if (this->stack_pointer >= 16){
+            trap(STACK_OVERFLOW);
+            return;
+        }
+    }
+    this->stack[this->stack_pointer & 0xFu] = this->program_counter;
+    this->program_counter = instr.nnn;
     this->stack_pointer++;
 } // - CALL addr
 
-void VChip8::OP_3xkk(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_3xkk(const Instruction& instr){
     //skips the next register if Vx register equals kk bytes
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t byte = OP_LAST_BYTE(this->opcode);
-
-    if (this->registers[register_idx] == byte)
-        this->program_counter += 2; 
+    if (this->registers[instr.x] == instr.kk)
+        skip(); 
 } // - SE Vx, byte
 
-void VChip8::OP_4xkk(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_4xkk(const Instruction& instr){
     //skips the next instruction if Vx register not equal to kk bytes
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t byte = OP_LAST_BYTE(this->opcode);
-    
-    if (this->registers[register_idx] != byte)
-        this->program_counter += 2;
+    if (this->registers[instr.x] != instr.kk)
+        skip();
 } // - SNE Vx, byte
 
-void VChip8::OP_5xy0(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_5xy0(const Instruction& instr){
     //skip the next instruction if Vx = Vy
-    //shift right to map layouts
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_2_idx = OP_REGISTER_2(this->opcode) >> 4u; 
-
-    if (this->registers[register_idx] == this->registers[register_2_idx])
-        this->program_counter += 2;
+    if (this->registers[instr.x] == this->registers[instr.y])
+        skip();
 } // - SE Vx, Vy
 
-void VChip8::OP_6xkk(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_6xkk(const Instruction& instr){
     //Load byte into Vx register
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t byte = OP_LAST_BYTE(this->opcode);
-
-    this->registers[register_idx] = byte;
+    this->registers[instr.x] = instr.kk;
 } // - LD Vx, byte
 
-void VChip8::OP_7xkk(){
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t byte = OP_LAST_BYTE(this->opcode);
-
-    this->registers[register_idx] += byte;
-
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_7xkk(const Instruction& instr){
+    this->registers[instr.x] += instr.kk;
 } // - ADD Vx, byte
 
-void VChip8::OP_8xy0(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy0(const Instruction& instr){
     //Load Vy into Vx
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    this->registers[register_idx_x] = this->registers[register_idx_y];
+    this->registers[instr.x] = this->registers[instr.y];
 } // - LD Vx, Vy
 
-void VChip8::OP_8xy1(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy1(const Instruction& instr){
     //bitwise OR between register Vx and Vy, Vx = Vx 
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    this->registers[register_idx_x] |= this->registers[register_idx_y];
+    this->registers[instr.x] |= this->registers[instr.y];
+    if (Quirks::logic_vf_reset)
+        this->registers[0xF] = 0;
 } // - OR Vx, Vy
 
-void VChip8::OP_8xy2(){
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    this->registers[register_idx_x] &= this->registers[register_idx_y];
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy2(const Instruction& instr){
+    this->registers[instr.x] &= this->registers[instr.y];
+    if (Quirks::logic_vf_reset)
+        this->registers[0xF] = 0;
 } // - AND Vx, Vy
 
-void VChip8::OP_8xy3(){
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    this->registers[register_idx_x] ^= this->registers[register_idx_y];
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy3(const Instruction& instr){
+    this->registers[instr.x] ^= this->registers[instr.y];
+    if (Quirks::logic_vf_reset)
+        this->registers[0xF] = 0;
 } // - XOR Vx, Vy
 
-void VChip8::OP_8xy4(){
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-	uint16_t sum = this->registers[register_idx_x] + 
-                        this->registers[register_idx_y];
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy4(const Instruction& instr){
+	uint16_t sum = this->registers[instr.x] + 
+                        this->registers[instr.y];
 
     //setting the carry flag
 	if (sum > 255U)
@@ -217,301 +500,765 @@ void VChip8::OP_8xy4(){
 	else
 		registers[0xF] = 0;
 
-	this->registers[register_idx_x] = sum & 0xFFu;
+	this->registers[instr.x] = sum & 0xFFu;
 } // - ADD Vx, Vy
 
-void VChip8::OP_8xy5(){
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    if (this->registers[register_idx_x] > this->registers[register_idx_y])
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy5(const Instruction& instr){
+    if (this->registers[instr.x] > this->registers[instr.y])
 		this->registers[0xF] = 1;
 	else
 		this->registers[0xF] = 0;
 
-	this->registers[register_idx_x] -= this->registers[register_idx_y];
+	this->registers[instr.x] -= this->registers[instr.y];
 } // - SUB Vx, Vy
 
-void VChip8::OP_8xy6(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy6(const Instruction& instr){
     //shift right Vx by 1 and save the least significant bit to the V_F
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
+    if constexpr (Quirks::shift_vy){
+        //the VIP shifts Vy into Vx, the flag is written last
+        uint8_t value = this->registers[instr.y];
+        this->registers[instr.x] = value >> 1;
+        this->registers[0xF] = value & 0x1u;
+        return;
+    }
 	// Save LSB in VF
-	this->registers[0xF] = (this->registers[register_idx_x] & 0x1u);
+	this->registers[0xF] = (this->registers[instr.x] & 0x1u);
 
-	this->registers[register_idx_x] >>= 1;
+	this->registers[instr.x] >>= 1;
 } // - SHR Vx by 1 
 
-void VChip8::OP_8xy7(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xy7(const Instruction& instr){
     //Set Vx = Vy - Vx, set VF = NOT borrow, basically reverse of SUB
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    if (this->registers[register_idx_x] > this->registers[register_idx_y])
+    if (this->registers[instr.x] > this->registers[instr.y])
 		this->registers[0xF] = 1;
 	else
 		this->registers[0xF] = 0;
 
-	this->registers[register_idx_x] = this->registers[register_idx_y] - this->registers[register_idx_x];
+	this->registers[instr.x] = this->registers[instr.y] - this->registers[instr.x];
 
 } // - SUBN Vx, Vy
 
-void VChip8::OP_8xyE(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_8xyE(const Instruction& instr){
     //shift left Vx by 1 and save the least significant bit to the V_F
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
+    if constexpr (Quirks::shift_vy){
+        uint8_t value = this->registers[instr.y];
+        this->registers[instr.x] = value << 1;
+        this->registers[0xF] = value >> 7u;
+        return;
+    }
 	// Save MSB in VF
-	this->registers[0xF] = (this->registers[register_idx_x] & 0x80) >> 7u;
+	this->registers[0xF] = (this->registers[instr.x] & 0x80) >> 7u;
     
-	this->registers[register_idx_x] = this->registers[register_idx_x] << 1;
+	this->registers[instr.x] = this->registers[instr.x] << 1;
 
 } // - SHL Vx {, Vy}
 
-void VChip8::OP_9xy0(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_9xy0(const Instruction& instr){
     //Skip next instruction if Vx != Vy.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-
-    if (this->registers[register_idx_x] != this->registers[register_idx_y])
-        this->program_counter += 2; //if matches shift the program counter
+    if (this->registers[instr.x] != this->registers[instr.y])
+        skip();
 } // - SNE Vx, Vy
 
-void VChip8::OP_Annn(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Annn(const Instruction& instr){
     //Load index register with address 
-    uint16_t address = OP_MEMORY(this->opcode);
-    this->index_register = address;
+    this->index_register = instr.nnn;
 } // - LD I, addr
 
-void VChip8::OP_Bnnn(){
-    //Jump to location nnn + V0
-    uint8_t address = OP_MEMORY(this->opcode);
-    this->program_counter = this->registers[0] + address;
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Bnnn(const Instruction& instr){
+    //Jump to location nnn + V0, SUPER-CHIP takes the register from the address: xnn + Vx
+    this->program_counter = this->registers[Quirks::jump_vx ? instr.x : 0] + instr.nnn;
 } // - JP V0, addr
 
-void VChip8::OP_Cxkk(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Cxkk(const Instruction& instr){
     //Set Vx = random byte AND kk.
-    uint8_t register_idx = OP_REGISTER(this->opcode) >> 8u;
-
-    uint8_t byte =  OP_LAST_BYTE(this->opcode);
-
-	this->registers[register_idx] = randByte(randGen) & byte;
+	this->registers[instr.x] = randByte(randGen) & instr.kk;
 } // - RND Vx, byte
 
-void VChip8::OP_Dxyn(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Dxyn(const Instruction& instr){
 
     //draw a sprite(nibble at x and y location contained in Vx and Vy registers)
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    uint8_t register_idx_y = OP_REGISTER_2(this->opcode) >> 4u;
-    uint8_t height = this->opcode & 0x000Fu;
-
-    //wrap around
-    uint8_t xPos = this->registers[register_idx_x] % this->VIDEO_WIDTH;
-    uint8_t yPos = this->registers[register_idx_y] % this->VIDEO_HEIGHT;
-
-    this->registers[0xFu] = 0; //set the 16th register to 0
-
-    for (unsigned int row = 0; row < height; ++row) {
-
-        //fetching the sprite byte
-        uint8_t spriteByte = this->memory[this->index_register + row];
-        for (unsigned int col = 0; col < 8; ++col){
-            //filling the video memory
-            uint8_t spritePixel = (spriteByte & (0x80u >> col));
-            uint32_t* screenPixel = &this->video_memory[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
-
-            //checking for the collisions 
-            if (spritePixel){
-                //whether the screen pixel is high as well?
-                if (*screenPixel == 0xFFFFFFFF) 
-                    this->registers[0xFu] = 1;
-                *screenPixel ^= 0xFFFFFFFF;
+#ifdef VCHIP8_PROFILE
+    auto drawStart = std::chrono::steady_clock::now();
+#endif
+
+    if (this->hires || this->plane_mask != 1 || (instr.n == 0 && this->mode != MODE_CHIP8)){
+        draw_planes(instr);
+#ifdef VCHIP8_PROFILE
+        this->profile.draw_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - drawStart).count();
+#endif
+        return;
+    }
+
+    if (!check_memory(instr.n))
+        return;
+
+    //wrap around the starting position, the sprite itself is clipped at the edges (or wraps too)
+    uint8_t xPos = this->registers[instr.x] % this->VIDEO_WIDTH;
+    uint8_t yPos = this->registers[instr.y] % this->VIDEO_HEIGHT;
+
+    uint64_t collision = 0;
+    unsigned int row = 0;
+    for (; row < instr.n && (Quirks::wrap_sprites || yPos + row < this->VIDEO_HEIGHT); ++row) {
+        unsigned int line = Quirks::wrap_sprites ? (yPos + row) % this->VIDEO_HEIGHT : yPos + row;
+
+        //fetching the sprite byte and moving it to its column, pixels past the right edge fall off
+        uint64_t bits = (uint64_t)this->memory[(this->index_register + row) & this->address_mask] << 56u;
+        uint64_t spriteRow = bits >> xPos;
+        if (Quirks::wrap_sprites && xPos != 0)
+            spriteRow |= bits << (64u - xPos);
+
+        //any pixel that is set on both sides is a collision
+        collision |= this->video_memory[line] & spriteRow;
+        this->video_memory[line] ^= spriteRow;
+    }
+    if (yPos + row > this->VIDEO_HEIGHT)
+        mark_dirty_rows(0, this->VIDEO_HEIGHT);
+    else if (row > 0)
+        mark_dirty_rows(yPos, yPos + row);
+    this->registers[0xFu] = (collision != 0); //VF flags the collision
+#ifdef VCHIP8_PROFILE
+    this->profile.draw_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - drawStart).count();
+#endif
+} // - DRW Vx, Vy, nibble
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::draw_planes(const Instruction& instr){
+    const unsigned int width = display_width();
+    const unsigned int height = display_height();
+    const bool wide = (instr.n == 0);               //16x16 sprite, two bytes per row
+    const unsigned int rows = wide ? 16 : instr.n;
+    const unsigned int xPos = this->registers[instr.x] % width;
+    const unsigned int yPos = this->registers[instr.y] % height;
+    if (!check_memory(rows * (wide ? 2 : 1) * ((this->plane_mask & 1u) + ((this->plane_mask >> 1) & 1u))))
+        return;
+
+    uint16_t address = this->index_register;
+    uint64_t collision = 0;
+    unsigned int drawn = 0;
+    for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+        if (!(this->plane_mask & (1u << p)))
+            continue;
+        uint64_t* plane = this->video_memory + p * PLANE_WORDS;
+
+        unsigned int row = 0;
+        for (; row < rows && (Quirks::wrap_sprites || yPos + row < height); ++row){
+            unsigned int line = Quirks::wrap_sprites ? (yPos + row) % height : yPos + row;
+            //the sprite row with its leftmost pixel on the most significant bit
+            uint64_t bits;
+            if (wide)
+                bits = (uint64_t)((this->memory[(address + 2 * row) & this->address_mask] << 8u) |
+                                  this->memory[(address + 2 * row + 1) & this->address_mask]) << 48u;
+            else
+                bits = (uint64_t)this->memory[(address + row) & this->address_mask] << 56u;
+
+            if (!this->hires){
+                uint64_t spriteRow = bits >> xPos;
+                if (Quirks::wrap_sprites && xPos != 0)
+                    spriteRow |= bits << (64 - xPos);
+                collision |= plane[line] & spriteRow;
+                plane[line] ^= spriteRow;
+                continue;
             }
+            //a hi-res row is two words, the pixels shifted out of the left one continue in the right one,
+            //whatever passes the right edge falls off (or continues in the left one)
+            uint64_t* words = plane + 2 * line;
+            uint64_t left = (xPos < 64) ? bits >> xPos : 0;
+            uint64_t right = (xPos == 0) ? 0 : (xPos < 64) ? bits << (64 - xPos) : bits >> (xPos - 64);
+            if (Quirks::wrap_sprites && xPos > 64)
+                left |= bits << (128 - xPos);
+            collision |= (words[0] & left) | (words[1] & right);
+            words[0] ^= left;
+            words[1] ^= right;
+        }
+        if (row > drawn)
+            drawn = row;
+        //with two planes selected the second plane's sprite follows the first
+        address += rows * (wide ? 2 : 1);
+    }
+    if (yPos + drawn > height)
+        mark_dirty_rows(0, height);
+    else if (drawn > 0)
+        mark_dirty_rows(yPos, yPos + drawn);
+    this->registers[0xFu] = (collision != 0);
+}
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::trap(ErrorCodes error){
+    //back on the faulting instruction, like 00FD
+    this->program_counter -= 2;
+    this->error_code = error;
+}
 
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_NULL(const Instruction&){
+    //an undefined opcode, usually a jump into data; the program counter stays on it for reports
+    if (!this->skip_undefined){
+        trap(UNDEFINED_INSTR);
+        return;
+    }
+    uint16_t address = (this->program_counter - 2) & this->address_mask;
+    std::vector<uint16_t>& seen = this->undefined_addresses;
+    if (std::find(seen.begin(), seen.end(), address) != seen.end())
+        return;
+    if (seen.size() < MAX_UNDEFINED)
+        seen.push_back(address);
+    else
+        this->undefined_overflow = true;
+}
+
+template<class Quirks, class Bounds>
+bool VChip8Core<Quirks, Bounds>::check_memory(unsigned int size){
+    if constexpr (Bounds::checked){
+        if (this->index_register + size > memory_size()){
+            trap(MEMORY_OUT_OF_BOUNDS);
+            return false;
         }
     }
-} // - DRW Vx, Vy, nibble
+    return true;
+}
 
-void VChip8::OP_Ex9E(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Ex9E(const Instruction& instr){
     //Skip next instruction if key with the value of Vx is pressed.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-	uint8_t key = this->registers[register_idx_x];
+	uint8_t key = this->registers[instr.x];
     //if the key was pressed?
 	if (this->keypad[key])
-		this->program_counter += 2;
+		skip();
 }// - SKP Vx
 
-void VChip8::OP_ExA1(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_ExA1(const Instruction& instr){
     //Skip next instruction if key with the value of Vx is not pressed.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-	uint8_t key = this->registers[register_idx_x];
+	uint8_t key = this->registers[instr.x];
     //if the key was pressed?
 	if (!this->keypad[key])
-		this->program_counter += 2;
+		skip();
 } // - SKNP Vx
 
-void VChip8::OP_Fx07(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx07(const Instruction& instr){
     //Set Vx = delay timer value.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-    this->registers[register_idx_x] = this->delay_timer;
+    this->registers[instr.x] = this->delay_timer;
 }// - LD Vx, DT
 
-void VChip8::OP_Fx0A(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx0A(const Instruction& instr){
     //Wait for a key press, store the value of the key in Vx.
-  uint8_t Vx = OP_REGISTER(this->opcode) >> 8u;
-
-	if (this->keypad[0])
-	{
-		this->registers[Vx] = 0;
-	}
-	else if (this->keypad[1])
-	{
-		this->registers[Vx] = 1;
-	}
-	else if (this->keypad[2])
-	{
-		this->registers[Vx] = 2;
-	}
-	else if (this->keypad[3])
-	{
-		this->registers[Vx] = 3;
-	}
-	else if (this->keypad[4])
-	{
-		this->registers[Vx] = 4;
-	}
-	else if (this->keypad[5])
-	{
-		this->registers[Vx] = 5;
-	}
-	else if (this->keypad[6])
-	{
-		this->registers[Vx] = 6;
-	}
-	else if (this->keypad[7])
-	{
-		this->registers[Vx] = 7;
-	}
-	else if (this->keypad[8])
-	{
-		this->registers[Vx] = 8;
-	}
-	else if (this->keypad[9])
-	{
-		this->registers[Vx] = 9;
-	}
-	else if (this->keypad[10])
-	{
-		this->registers[Vx] = 10;
-	}
-	else if (this->keypad[11])
-	{
-		this->registers[Vx] = 11;
-	}
-	else if (this->keypad[12])
-	{
-		this->registers[Vx] = 12;
-	}
-	else if (this->keypad[13])
-	{
-		this->registers[Vx] = 13;
-	}
-	else if (this->keypad[14])
-	{
-		this->registers[Vx] = 14;
-	}
-	else if (this->keypad[15])
-	{
-		this->registers[Vx] = 15;
-	}
-	else
-	{
+	uint16_t keys = pressed_keys();
+	if (!keys){
+		//stay on this instruction and halt, run() executes nothing more until a key is down
 		this->program_counter -= 2;
+		this->halted = true;
+		return;
 	}
+	//the lowest pressed key wins
+	uint8_t key = 0;
+	while (!(keys & (1u << key)))
+		++key;
+	this->registers[instr.x] = key;
+	this->halted = false;
 }// - LD Vx, K          
 
-void VChip8::OP_Fx15(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx15(const Instruction& instr){
     // Set delay timer = Vx.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
-	this->delay_timer = this->registers[register_idx_x];
+	this->delay_timer = this->registers[instr.x];
 }// - LD DT, Vx
 
-void VChip8::OP_Fx18(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx18(const Instruction& instr){
      // Set sound timer = Vx.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
-	this->sound_timer = this->registers[register_idx_x];
+	this->sound_timer = this->registers[instr.x];
 }// - LD ST, Vx
 
-void VChip8::OP_Fx1E(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx1E(const Instruction& instr){
     //Set I = I + Vx.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
-	this->index_register += this->registers[register_idx_x];
+	this->index_register += this->registers[instr.x];
 }// - ADD I, Vx
 
-void VChip8::OP_Fx29(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx29(const Instruction& instr){
     //Set I = location of sprite for digit Vx.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
-	uint8_t digit = this->registers[register_idx_x];
+	uint8_t digit = this->registers[instr.x];
 
 	this->index_register = FONT_MEM + (5 * digit);
 }// - LD F, Vx
 
-void VChip8::OP_Fx33(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx33(const Instruction& instr){
     //Store BCD representation of Vx in memory locations I, I+1, and I+2.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-	uint8_t value = this->registers[register_idx_x];
+	if (!check_memory(3))
+		return;
+	uint8_t value = this->registers[instr.x];
 
 	// Ones-place
-	this->memory[this->index_register + 2] = value % 10;
+	this->memory[(this->index_register + 2) & this->address_mask] = value % 10;
 	value /= 10;
 
 	// Tens-place
-	this->memory[this->index_register + 1] = value % 10;
+	this->memory[(this->index_register + 1) & this->address_mask] = value % 10;
 	value /= 10;
 
 	// Hundreds-place
-	this->memory[this->index_register] = value % 10;
+	this->memory[this->index_register & this->address_mask] = value % 10;
+
+	invalidate_written(this->index_register & this->address_mask, 3);
 }// - LD B, Vx
 
-void VChip8::OP_Fx55(){
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-	for (uint8_t i = 0; i <= register_idx_x; ++i)
-		this->memory[this->index_register + i] = registers[i];
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx55(const Instruction& instr){
+    // Store registers V0 through Vx in memory starting at location I.
+	if (!check_memory(instr.x + 1u))
+		return;
+	for (uint8_t i = 0; i <= instr.x; ++i)
+		this->memory[(this->index_register + i) & this->address_mask] = registers[i];
+
+	invalidate_written(this->index_register & this->address_mask, instr.x + 1);
+	if (Quirks::load_store_index)
+		this->index_register += instr.x + 1;
 }// - LD [I], Vx
 
-void VChip8::OP_Fx65(){
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx65(const Instruction& instr){
     // Read registers V0 through Vx from memory starting at location I.
-    uint8_t register_idx_x = OP_REGISTER(this->opcode) >> 8u;
-
-	for (uint8_t i = 0; i <= register_idx_x; ++i)
-		registers[i] = this->memory[this->index_register + i];
+	if (!check_memory(instr.x + 1u))
+		return;
+	for (uint8_t i = 0; i <= instr.x; ++i)
+		registers[i] = this->memory[(this->index_register + i) & this->address_mask];
+	if (Quirks::load_store_index)
+		this->index_register += instr.x + 1;
 }// - LD Vx, [I]
 
+namespace {
+
+    //moves the rows of a plane down (rows > 0) or up (rows < 0) with whole-word copies, rows scrolled in are blank
+    void scroll_vertical(uint64_t* plane, unsigned int rowWords, unsigned int height, int rows){
+        unsigned int distance = (unsigned int)(rows < 0 ? -rows : rows);
+        if (distance > height)
+            distance = height;
+        size_t kept = (height - distance) * rowWords;
+        size_t cleared = distance * rowWords;
+        if (rows > 0){
+            memmove(plane + cleared, plane, kept * sizeof(uint64_t));
+            memset(plane, 0, cleared * sizeof(uint64_t));
+        }
+        else{
+            memmove(plane, plane + cleared, kept * sizeof(uint64_t));
+            memset(plane + kept, 0, cleared * sizeof(uint64_t));
+        }
+    }
 
-void VChip8::cycle(){
-	//Fetch
-	this->opcode = (this->memory[this->program_counter] << 8u) | this->memory[this->program_counter + 1];;
+}
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00Cn(const Instruction& instr){
+    //scroll the selected planes down by n rows of the current resolution
+    for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+        if (this->plane_mask & (1u << p))
+            scroll_vertical(this->video_memory + p * PLANE_WORDS, this->hires ? 2 : 1, display_height(), instr.n);
+    }
+    mark_dirty_rows(0, display_height());
+} // - SCD nibble
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00Dn(const Instruction& instr){
+    //scroll the selected planes up by n rows
+    for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+        if (this->plane_mask & (1u << p))
+            scroll_vertical(this->video_memory + p * PLANE_WORDS, this->hires ? 2 : 1, display_height(), -(int)instr.n);
+    }
+    mark_dirty_rows(0, display_height());
+} // - scroll-up nibble
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00FB(const Instruction&){
+    //scroll right by 4 pixels, a hi-res row carries the bits between its two words
+    for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+        if (!(this->plane_mask & (1u << p)))
+            continue;
+        uint64_t* plane = this->video_memory + p * PLANE_WORDS;
+        if (!this->hires){
+            for (unsigned int row = 0; row < this->VIDEO_HEIGHT; row++)
+                plane[row] >>= 4;
+            continue;
+        }
+        for (unsigned int row = 0; row < this->HIRES_HEIGHT; row++){
+            uint64_t* line = plane + 2 * row;
+            line[1] = (line[1] >> 4) | (line[0] << 60);
+            line[0] >>= 4;
+        }
+    }
+    mark_dirty_rows(0, display_height());
+} // - SCR
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00FC(const Instruction&){
+    //scroll left by 4 pixels
+    for (unsigned int p = 0; p < VIDEO_PLANES; p++){
+        if (!(this->plane_mask & (1u << p)))
+            continue;
+        uint64_t* plane = this->video_memory + p * PLANE_WORDS;
+        if (!this->hires){
+            for (unsigned int row = 0; row < this->VIDEO_HEIGHT; row++)
+                plane[row] <<= 4;
+            continue;
+        }
+        for (unsigned int row = 0; row < this->HIRES_HEIGHT; row++){
+            uint64_t* line = plane + 2 * row;
+            line[0] = (line[0] << 4) | (line[1] >> 60);
+            line[1] <<= 4;
+        }
+    }
+    mark_dirty_rows(0, display_height());
+} // - SCL
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00FD(const Instruction&){
+    //the program is done, stay on the instruction and stop
+    this->program_counter -= 2;
+    this->error_code = PROGRAM_EXITED;
+} // - EXIT
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00FE(const Instruction&){
+    //switching resolution clears every plane
+    this->hires = false;
+    memset(this->video_memory, 0, sizeof(this->video_memory));
+    mark_dirty_rows(0, this->VIDEO_HEIGHT);
+} // - LOW
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_00FF(const Instruction&){
+    this->hires = true;
+    memset(this->video_memory, 0, sizeof(this->video_memory));
+    mark_dirty_rows(0, this->HIRES_HEIGHT);
+} // - HIGH
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx30(const Instruction& instr){
+    //Set I = location of the 8x10 sprite for digit Vx.
+    this->index_register = BIG_FONT_MEM + 10 * (this->registers[instr.x] & 0xFu);
+} // - LD HF, Vx
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx75(const Instruction& instr){
+    //Store V0 through Vx in the flag registers.
+    memcpy(this->flag_registers, this->registers, instr.x + 1u);
+} // - LD R, Vx
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx85(const Instruction& instr){
+    //Read V0 through Vx from the flag registers.
+    memcpy(this->registers, this->flag_registers, instr.x + 1u);
+} // - LD Vx, R
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_5xy2(const Instruction& instr){
+    //Store Vx through Vy (either direction) in memory starting at I, I is unchanged.
+    unsigned int count = (instr.x < instr.y) ? instr.y - instr.x : instr.x - instr.y;
+    if (!check_memory(count + 1))
+        return;
+    for (unsigned int i = 0; i <= count; i++){
+        uint8_t reg = (instr.x < instr.y) ? instr.x + i : instr.x - i;
+        this->memory[(this->index_register + i) & this->address_mask] = this->registers[reg];
+    }
+    invalidate_written(this->index_register & this->address_mask, count + 1);
+} // - save vx - vy
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_5xy3(const Instruction& instr){
+    //Read Vx through Vy (either direction) from memory starting at I.
+    unsigned int count = (instr.x < instr.y) ? instr.y - instr.x : instr.x - instr.y;
+    if (!check_memory(count + 1))
+        return;
+    for (unsigned int i = 0; i <= count; i++){
+        uint8_t reg = (instr.x < instr.y) ? instr.x + i : instr.x - i;
+        this->registers[reg] = this->memory[(this->index_register + i) & this->address_mask];
+    }
+} // - load vx - vy
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_F000(const Instruction&){
+    //Set I = the 16-bit word following the instruction, then step over it.
+    this->index_register = (this->memory[this->program_counter & this->address_mask] << 8u) |
+                           this->memory[(this->program_counter + 1) & this->address_mask];
+    this->program_counter += 2;
+} // - i := long nnnn
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fn01(const Instruction& instr){
+    //Select the planes drawn, cleared and scrolled.
+    this->plane_mask = instr.x & 0x3u;
+} // - plane n
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_F002(const Instruction&){
+    //Load the 16-byte audio pattern from I.
+    if (!check_memory(sizeof(this->audio_pattern)))
+        return;
+    for (unsigned int i = 0; i < sizeof(this->audio_pattern); i++)
+        this->audio_pattern[i] = this->memory[(this->index_register + i) & this->address_mask];
+} // - audio
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::OP_Fx3A(const Instruction& instr){
+    //Set the audio pattern playback rate.
+    this->pitch = this->registers[instr.x];
+} // - pitch := vx
+
+
+VChip8Machine::Instruction VChip8Machine::decode(uint16_t opcode) const{
+	Instruction instr;
+	instr.x = OP_REGISTER(opcode) >> 8u;
+	instr.y = OP_REGISTER_2(opcode) >> 4u;
+	instr.kk = OP_LAST_BYTE(opcode);
+	instr.nnn = OP_MEMORY(opcode);
+	instr.n = opcode & 0x000Fu;
+	instr.length = 1;
+
+	const DecodeTables& tables = decode_tables[this->mode];
+	switch (opcode >> 12u)
+	{
+	case 0x0:
+		instr.id = (instr.x == 0 || !tables.strict0) ? tables.table0[instr.kk] : (uint8_t)ID_NULL;
+		break;
+	case 0x5:
+		instr.id = tables.table5[instr.n];
+		break;
+	case 0x8:
+		instr.id = tables.table8[instr.n];
+		break;
+	case 0xE:
+		instr.id = tables.tableE[instr.n];
+		break;
+	case 0xF:
+		instr.id = tables.tableF[instr.kk];
+		//F000 nnnn and F002 take no register
+		if ((instr.id == ID_F000 || instr.id == ID_F002) && instr.x != 0)
+			instr.id = ID_NULL;
+		break;
+	default:
+		instr.id = tables.table[opcode >> 12u];
+		break;
+	}
+	return instr;
+}
+
+void VChip8Machine::decode_block(uint16_t address){
+	//decode the straight-line run starting at address, stopping after the first
+	//instruction that may change the flow of control or write to memory
+	unsigned int length = 0;
+	uint16_t pc = address;
+	while (length < MAX_BLOCK_LENGTH && pc + 1u < 0x1000u){
+		Instruction instr = decode((this->memory[pc] << 8u) | this->memory[pc + 1]);
+		this->icache[pc - this->ROM_MEM] = instr;
+		++length;
+		pc += 2;
+
+		bool terminator = true;
+		switch (instr.id)
+		{
+		case ID_00E0: case ID_6xkk: case ID_7xkk: case ID_8xy0: case ID_8xy1:
+		case ID_8xy2: case ID_8xy3: case ID_8xy4: case ID_8xy5: case ID_8xy6:
+		case ID_8xy7: case ID_8xyE: case ID_Annn: case ID_Cxkk: case ID_Dxyn:
+		case ID_Fx07: case ID_Fx15: case ID_Fx18: case ID_Fx1E: case ID_Fx29:
+		case ID_Fx65:
+			terminator = false;
+			break;
+		}
+		if (terminator)
+			break;
+	}
+
+	//every entry of the run starts a (shorter) block of its own
+	for (unsigned int i = 0; i < length; i++){
+		this->icache[address + 2 * i - this->ROM_MEM].length = length - i;
+	}
+	for (uint16_t i = address; i < pc; i++){
+		this->code_map[i / 64] |= 1ull << (i % 64);
+	}
+}
+
+const VChip8Machine::Instruction& VChip8Machine::fetch(uint16_t address){
+	if (address >= this->ROM_MEM && address + 1u < 0x1000u){
+		Instruction& instr = this->icache[address - this->ROM_MEM];
+		if (!instr.length)
+			decode_block(address);
+		return instr;
+	}
+	//outside the cached range, decode every time
+	this->uncached = decode((this->memory[address & this->address_mask] << 8u) | this->memory[(address + 1) & this->address_mask]);
+	return this->uncached;
+}
+
+void VChip8Machine::invalidate_code(uint16_t address, uint16_t size){
+	unsigned int end = address + size;
+	if (end > 0x1000u)
+		end = 0x1000u;
+
+	for (unsigned int page = address / 256; page * 256 < end; page++){
+		++this->page_generation[page];
+	}
+
+	bool cached = false;
+	for (unsigned int i = address; i < end && !cached; i++){
+		cached = (this->code_map[i / 64] >> (i % 64)) & 1u;
+	}
+	if (!cached)
+		return;
+
+	//any block covering the written bytes starts at most MAX_BLOCK_LENGTH instructions earlier
+	unsigned int start = address;
+	start = (start > 2 * MAX_BLOCK_LENGTH - 1) ? start - (2 * MAX_BLOCK_LENGTH - 1) : 0;
+	if (start < (unsigned int)this->ROM_MEM)
+		start = this->ROM_MEM;
+	for (unsigned int i = start; i < end; i++){
+		this->icache[i - this->ROM_MEM].length = 0;
+	}
+}
+
+void VChip8Machine::invalidate_written(unsigned int address, unsigned int size){
+	unsigned int end = address + size;
+	if (end <= memory_size()){
+		invalidate_code(address, size);
+		return;
+	}
+	//the write wrapped around to the start of memory
+	invalidate_code(address, memory_size() - address);
+	invalidate_code(0, end - memory_size());
+}
+
+void VChip8Machine::flush_code_cache(){
+	//only 64-byte windows marked in code_map ever held decoded entries, so a ROM that ran a
+	//little code (or none, right after reset) clears a few hundred bytes instead of the whole cache
+	for (unsigned int word = this->ROM_MEM / 64; word < 0x1000 / 64; word++){
+		if (this->code_map[word]){
+			memset(&this->icache[word * 64 - this->ROM_MEM], 0, 64 * sizeof(Instruction));
+			this->code_map[word] = 0;
+		}
+	}
+	for (unsigned int page = 0; page < 0x1000 / 256; page++){
+		++this->page_generation[page];
+	}
+}
+
+template<class Quirks, class Bounds>
+void VChip8Core<Quirks, Bounds>::cycle(){
+	//Fetch and decode, served from the instruction cache
+	const Instruction& instr = fetch(this->program_counter);
+	PROFILE_INSTRUCTION(instr, this->program_counter);
 
 	// Increment the PC before we execute anything
 	this->program_counter += 2;
 
-	// Decode and Execute
-	((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+	// Execute
+	((*this).*(handlers[instr.id]))(instr);
+}
 
-	// Decrement the delay timer if it's been set
-	if (this->delay_timer > 0)
-		--this->delay_timer;
+template<class Quirks, class Bounds>
+unsigned int VChip8Core<Quirks, Bounds>::run(unsigned int instructions){
+	//halted on Fx0A, nothing runs until a key is down
+	if (!wake())
+		return 0;
+	unsigned int executed = 0;
+#ifndef VCHIP8_PROFILE
+	uint64_t probed = 0; //jumps already tried by idle_loop() in this call, one bit per address modulo 64
+#endif
+	while (executed < instructions && this->error_code == ALL_OKAY && !this->halted){
+		uint16_t start = this->program_counter;
+		const Instruction* block = &fetch(start);
+		unsigned int length = block->length;
+		if (length > instructions - executed)
+			length = instructions - executed;
+
+		//the block is straight-line code, only its last instruction may branch
+		for (unsigned int i = 0; i < length; i++){
+			const Instruction& instr = block[2 * i];
+			PROFILE_INSTRUCTION(instr, this->program_counter);
+			this->program_counter += 2;
+			((*this).*(handlers[instr.id]))(instr);
+			//a trap stops the block on the faulting instruction
+			if constexpr (Bounds::checked){
+				if (this->error_code != ALL_OKAY){
+					length = i + 1;
+					break;
+				}
+			}
+		}
+		executed += length;
+
+#ifndef VCHIP8_PROFILE
+		//a jump backwards may close an idle loop; profiling builds count every instruction instead
+		const Instruction& last = block[2 * (length - 1)];
+		uint16_t jump = start + 2 * (length - 1);
+		if (last.id == ID_1nnn && last.nnn <= jump && this->skip_idle_loops && !((probed >> (jump / 2 % 64)) & 1u)){
+			probed |= 1ull << (jump / 2 % 64);
+			executed += idle_loop(jump, instructions - executed);
+		}
+#endif
+	}
+	return executed;
+}
 
-	// Decrement the sound timer if it's been set
-	if (this->sound_timer > 0)
-	{
-		--this->sound_timer;
+template<class Quirks, class Bounds>
+unsigned int VChip8Core<Quirks, Bounds>::idle_loop(uint16_t jump, unsigned int budget){
+	//up to two more passes through the loop, stepped; they must stay between the target and
+	//the jump and run only reads_only() instructions
+	uint16_t target = this->program_counter;
+	uint8_t registers[16];
+	memcpy(registers, this->registers, sizeof(registers));
+	uint16_t index = this->index_register;
+	unsigned int executed = 0, pass = 0, passes = 0;
+	while (executed < budget && this->error_code == ALL_OKAY){
+		uint16_t pc = this->program_counter;
+		if (pc < target || pc > jump)
+			break;
+		const Instruction& instr = fetch(pc);
+		if (!reads_only(instr.id))
+			break;
+		this->program_counter += 2;
+		((*this).*(handlers[instr.id]))(instr);
+		++executed;
+		if (pc != jump)
+			continue;
+
+		//back at the target with every register as before: nothing the loop reads changes before the
+		//timers tick, so every further pass is the same and the whole passes left are only counted;
+		//the rest of the budget runs normally and ends on the same instruction as stepping would
+		if (this->program_counter == target && this->index_register == index &&
+		    memcmp(registers, this->registers, sizeof(registers)) == 0){
+			unsigned int length = executed - pass;
+			executed += (budget - executed) / length * length;
+			break;
+		}
+		//the first pass may have started on registers from before the loop was entered or the timers ticked
+		if (++passes == 2 || this->program_counter != target)
+			break;
+		memcpy(registers, this->registers, sizeof(registers));
+		index = this->index_register;
+		pass = executed;
 	}
+	return executed;
+}
+
+template<class Quirks, class Bounds>
+unsigned int VChip8Core<Quirks, Bounds>::run_frame(unsigned int instructions){
+	unsigned int executed = run(instructions);
+	tick_timers();
+	return executed;
 }
 
-std::string VChip8::get_error_name(){
+std::string VChip8Machine::get_error_name(){
 	switch (this->error_code)
 	{
 	case ALL_OKAY:
@@ -520,8 +1267,28 @@ std::string VChip8::get_error_name(){
 		return "Error, size of ROM is larger than the memory.";
 	case FILE_NOT_FOUND:
 		return "Error, couldn't load the ROM file";
+	case UNDEFINED_INSTR:
+		return "Error, undefined instruction";
+	case PROGRAM_EXITED:
+		return "The program exited (00FD)";
+	case STACK_OVERFLOW:
+		return "Error, call with a full stack (2nnn)";
+	case STACK_UNDERFLOW:
+		return "Error, return with an empty stack (00EE)";
+	case MEMORY_OUT_OF_BOUNDS:
+		return "Error, memory access past the end of memory from I";
 	default:
 		return "Uknown, error occurred";
 	}
 	return ""; //for the sake of return
-}
\ No newline at end of file
+}
+
+//the profiles of point 16 under both bounds policies, see chip_8.hpp
+template class VChip8Core<VChip8Quirks, VChip8BoundsMasked>;
+template class VChip8Core<VChip8QuirksVip, VChip8BoundsMasked>;
+template class VChip8Core<VChip8QuirksSchip, VChip8BoundsMasked>;
+template class VChip8Core<VChip8QuirksOcto, VChip8BoundsMasked>;
+template class VChip8Core<VChip8Quirks, VChip8BoundsChecked>;
+template class VChip8Core<VChip8QuirksVip, VChip8BoundsChecked>;
+template class VChip8Core<VChip8QuirksSchip, VChip8BoundsChecked>;
+template class VChip8Core<VChip8QuirksOcto, VChip8BoundsChecked>;
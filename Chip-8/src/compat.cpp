@@ -0,0 +1,224 @@
+#include "../include/chip_8.hpp"
+#include "../include/movie.hpp"
+#include "../include/rom_cache.hpp"
+#include "../include/runner.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//ROM compatibility suite: runs every ROM of a directory on the work-stealing runner and compares the
+//framebuffer hash at fixed checkpoints with the ROM's golden file. Undefined opcodes run as no-ops
+//(VChip8::skip_undefined) so every one the run reaches is reported with its address, not just the
+//first. Next to pong.ch8 the suite looks for
+//    pong.ch8.vc8m    input movie (VChip8 --record), its keypad and seed drive the ROM
+//    pong.ch8.golden  one "<frame> <frame hash>" line per checkpoint, written by --update
+//The extension picks the instruction set: .ch8 CHIP-8, .sc8 SUPER-CHIP, .xo8 XO-CHIP.
+
+namespace {
+
+    struct Rom{
+        std::string path;   //the file's own, images are shared by files with the same contents
+        std::shared_ptr<const VChip8RomImage> image;
+        VChip8::Mode mode;
+        std::unique_ptr<VChip8Movie> movie;
+    };
+
+    bool ends_with(const std::string& text, const char* suffix){
+        size_t length = std::strlen(suffix);
+        return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+    }
+
+    bool rom_mode(const std::string& path, VChip8::Mode& mode){
+        if (ends_with(path, ".ch8"))
+            mode = VChip8::MODE_CHIP8;
+        else if (ends_with(path, ".sc8"))
+            mode = VChip8::MODE_SCHIP;
+        else if (ends_with(path, ".xo8"))
+            mode = VChip8::MODE_XOCHIP;
+        else
+            return false;
+        return true;
+    }
+
+    //the checkpoint hashes of a golden file in order, false if there is none
+    bool read_golden(const std::string& path, uint64_t every, std::vector<uint64_t>& hashes){
+        std::ifstream file(path);
+        if (!file.is_open())
+            return false;
+        unsigned long long frame;
+        std::string hash;
+        while (file >> frame >> hash){
+            //a golden file written with another interval can't match
+            if (frame != (hashes.size() + 1) * every)
+                hashes.push_back(0);
+            else
+                hashes.push_back(std::strtoull(hash.c_str(), nullptr, 16));
+        }
+        return true;
+    }
+
+    bool write_golden(const std::string& path, uint64_t every, const std::vector<uint64_t>& hashes){
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        for (size_t i = 0; i < hashes.size(); i++)
+            std::fprintf(file, "%llu %016llx\n", (unsigned long long)((i + 1) * every), (unsigned long long)hashes[i]);
+        return std::fclose(file) == 0;
+    }
+
+    [[noreturn]] void usage(const char* program){
+        std::fprintf(stderr, "Usage: %s <ROM directory> [--frames N] [--every N] [--ipf N] [--threads N] [--update]\n"
+                             "  --frames N   frames every ROM runs (default 600)\n"
+                             "  --every N    frames between checkpoints (default 60)\n"
+                             "  --ipf N      instructions per 60Hz frame (default 10)\n"
+                             "  --threads N  runner worker threads (default one per hardware thread)\n"
+                             "  --update     write the golden files from this run instead of comparing\n", program);
+        std::exit(EXIT_FAILURE);
+    }
+
+}
+
+int main(int argc, char** argv){
+
+    if (argc < 2)
+        usage(argv[0]);
+    const char* directory = argv[1];
+    uint64_t frames = 600;
+    uint64_t every = 60;
+    unsigned int instructionsPerFrame = 10;
+    unsigned int threads = 0;
+    bool update = false;
+    for (int i = 2; i < argc; i++){
+        if (std::strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (i + 1 >= argc)
+            usage(argv[0]);
+        else if (std::strcmp(argv[i], "--frames") == 0)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--every") == 0)
+            every = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--ipf") == 0)
+            instructionsPerFrame = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--threads") == 0)
+            threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else
+            usage(argv[0]);
+    }
+    if (every == 0 || instructionsPerFrame == 0)
+        usage(argv[0]);
+
+    //every ROM of the directory, each file is read once and loaded from the image
+    std::vector<Rom> roms;
+    for (const VChip8RomFile& file : VChip8RomCache::shared().open_directory(directory)){
+        Rom rom;
+        if (!rom_mode(file.path, rom.mode))
+            continue;
+        rom.path = file.path;
+        rom.image = file.image;
+        std::unique_ptr<VChip8Movie> movie(new VChip8Movie());
+        if (movie->load((file.path + ".vc8m").c_str())){
+            if (movie->instructions_per_frame != instructionsPerFrame)
+                std::fprintf(stderr, "%s: the movie was recorded at %u instructions per frame, running at %u\n",
+                             file.path.c_str(), movie->instructions_per_frame, instructionsPerFrame);
+            if (movie->mode != rom.mode)
+                std::fprintf(stderr, "%s: the movie was recorded in mode %u, running in mode %u from the extension\n",
+                             file.path.c_str(), (unsigned int)movie->mode, (unsigned int)rom.mode);
+            rom.movie = std::move(movie);
+        }
+        roms.push_back(std::move(rom));
+    }
+    if (roms.empty()){
+        std::fprintf(stderr, "No .ch8, .sc8 or .xo8 ROMs in %s\n", directory);
+        return -1;
+    }
+
+    VChip8Runner runner(threads);
+    runner.set_checkpoints(every);
+    for (size_t i = 0; i < roms.size(); i++){
+        VChip8& chip8 = runner.add();
+        chip8.randGen.seed(roms[i].movie ? roms[i].movie->seed : 0);
+        chip8.set_mode(roms[i].mode);
+        chip8.skip_undefined = true;
+        chip8.loadRom(roms[i].image->data(), roms[i].image->size());
+        if (roms[i].movie)
+            runner.set_input(i, *roms[i].movie);
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    runner.run(frames, instructionsPerFrame);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    unsigned int passed = 0, failed = 0, missing = 0, undefined = 0;
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < roms.size(); i++){
+        const VChip8Runner::Result& result = runner.results()[i];
+        VChip8& chip8 = runner.instance(i);
+        const std::string& path = roms[i].path;
+        instructions += result.instructions;
+
+        //the opcode as it is in memory at the end of the run, addresses wrap like the machine's fetches
+        size_t mask = chip8.memory_size() - 1;
+        for (uint16_t address : chip8.undefined_addresses){
+            unsigned int opcode = (chip8.memory[address] << 8u) | chip8.memory[(address + 1) & mask];
+            std::printf("UNDEFINED %s: opcode %04X at 0x%03X\n", path.c_str(), opcode, address);
+            ++undefined;
+        }
+        if (chip8.undefined_overflow)
+            std::printf("UNDEFINED %s: only the first %zu addresses are listed\n", path.c_str(), VChip8::MAX_UNDEFINED);
+        if (result.error_code != VChip8::ALL_OKAY && result.error_code != VChip8::PROGRAM_EXITED){
+            std::printf("ERROR %s: %s at 0x%03X, frame %llu\n", path.c_str(), chip8.get_error_name().c_str(),
+                        chip8.program_counter, (unsigned long long)result.frames);
+        }
+
+        std::string goldenPath = path + ".golden";
+        if (update){
+            if (!write_golden(goldenPath, every, result.checkpoints)){
+                std::fprintf(stderr, "Couldn't write %s\n", goldenPath.c_str());
+                return -1;
+            }
+            continue;
+        }
+
+        std::vector<uint64_t> golden;
+        if (!read_golden(goldenPath, every, golden)){
+            std::printf("MISSING %s: no golden file\n", path.c_str());
+            ++missing;
+            continue;
+        }
+        size_t checked = golden.size() < result.checkpoints.size() ? golden.size() : result.checkpoints.size();
+        size_t mismatch = 0;
+        while (mismatch < checked && golden[mismatch] == result.checkpoints[mismatch])
+            ++mismatch;
+        if (mismatch < checked){
+            std::printf("FAIL %s: frame %llu is %016llx, expected %016llx\n", path.c_str(),
+                        (unsigned long long)((mismatch + 1) * every), (unsigned long long)result.checkpoints[mismatch],
+                        (unsigned long long)golden[mismatch]);
+            ++failed;
+        }
+        else if (golden.size() != result.checkpoints.size()){
+            //one of the runs stopped early
+            std::printf("FAIL %s: %zu checkpoints, expected %zu\n", path.c_str(), result.checkpoints.size(), golden.size());
+            ++failed;
+        }
+        else
+            ++passed;
+    }
+
+    std::printf("roms:              %zu\n"
+                "passed:            %u\n"
+                "failed:            %u\n"
+                "missing golden:    %u\n"
+                "undefined opcodes: %u\n"
+                "instructions:      %llu\n"
+                "seconds:           %.6f\n",
+                roms.size(), passed, failed, missing, undefined, (unsigned long long)instructions, seconds);
+    if (update)
+        std::printf("golden files written for %zu ROMs\n", roms.size());
+
+    return update || (failed == 0 && missing == 0 && undefined == 0) ? 0 : -1;
+}
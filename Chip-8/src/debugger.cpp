@@ -0,0 +1,460 @@
+#include "../include/debugger.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define VCHIP8_DEBUG_SOCKETS 1
+#endif
+
+namespace {
+
+    //disassembly of every InstrId: %x and %y are the register nibbles, %k the byte, %a the address,
+    //%n the last nibble and %w the word after F000
+    const char* const mnemonics[VChip8Machine::ID_COUNT] = {
+        "???",
+        "CLS", "RET", "JP %a", "CALL %a", "SE V%x, %k", "SNE V%x, %k", "SE V%x, V%y",
+        "LD V%x, %k", "ADD V%x, %k", "LD V%x, V%y", "OR V%x, V%y", "AND V%x, V%y", "XOR V%x, V%y",
+        "ADD V%x, V%y", "SUB V%x, V%y", "SHR V%x, V%y", "SUBN V%x, V%y", "SHL V%x, V%y", "SNE V%x, V%y",
+        "LD I, %a", "JP V0, %a", "RND V%x, %k", "DRW V%x, V%y, %n", "SKP V%x", "SKNP V%x",
+        "LD V%x, DT", "LD V%x, K", "LD DT, V%x", "LD ST, V%x", "ADD I, V%x", "LD F, V%x",
+        "LD B, V%x", "LD [I], V%x", "LD V%x, [I]",
+        "SCD %n", "SCU %n", "SCR", "SCL", "EXIT", "LOW", "HIGH", "SAVE V%x - V%y", "LOAD V%x - V%y",
+        "LD I, %w", "PLANE %x", "AUDIO", "LD HF, V%x", "PITCH V%x", "LD R, V%x", "LD V%x, R"
+    };
+
+    //hex for addresses and values, with or without 0x
+    bool parse_hex(std::istringstream& in, unsigned long& value){
+        std::string word;
+        if (!(in >> word))
+            return false;
+        char* end = nullptr;
+        value = std::strtoul(word.c_str(), &end, 16);
+        return *end == '\0';
+    }
+
+    bool parse_count(std::istringstream& in, unsigned long long& value){
+        std::string word;
+        if (!(in >> word))
+            return false;
+        char* end = nullptr;
+        value = std::strtoull(word.c_str(), &end, 10);
+        return *end == '\0';
+    }
+
+    //"V3" or "v3"
+    bool parse_register(std::istringstream& in, unsigned int& index){
+        std::string word;
+        if (!(in >> word) || word.size() != 2 || (word[0] != 'V' && word[0] != 'v') || !std::isxdigit((unsigned char)word[1]))
+            return false;
+        index = (unsigned int)std::strtoul(word.c_str() + 1, nullptr, 16);
+        return true;
+    }
+
+    const char* const help_text =
+        "break ADDR | delete ADDR          PC breakpoint\n"
+        "watch ADDR [LEN] | unwatch ADDR [LEN]  memory write watchpoint\n"
+        "reg Vx [VALUE] | unreg Vx         stop when Vx changes or becomes VALUE\n"
+        "step [N]                          execute N instructions (default 1)\n"
+        "until ADDR [FRAMES]               run to ADDR, at most FRAMES frames (default 3600)\n"
+        "continue [FRAMES]                 run until stopped, at most FRAMES frames (default 3600)\n"
+        "regs | mem ADDR [LEN] | dis [ADDR] [N] | keys BITS | help | quit\n";
+
+    const uint64_t DEFAULT_FRAMES = 3600; //a minute of emulated time
+
+}
+
+void VChip8Debugger::assign(uint64_t* map, unsigned int address, bool value, unsigned int& count){
+    if (test(map, address) == value)
+        return;
+    map[address / 64] ^= 1ull << (address % 64);
+    if (value)
+        ++count;
+    else
+        --count;
+}
+
+void VChip8Debugger::set_breakpoint(uint16_t address, bool armed){
+    assign(this->breakpoints, address, armed, this->breakpoint_count);
+}
+
+void VChip8Debugger::set_watchpoint(uint16_t address, uint16_t length, bool armed){
+    for (unsigned int i = 0; i < length; i++)
+        assign(this->watchpoints, (address + i) % (MAP_WORDS * 64), armed, this->watchpoint_count);
+}
+
+void VChip8Debugger::watch_register(unsigned int index, int value){
+    this->register_mask |= 1u << (index & 0xF);
+    this->register_values[index & 0xF] = value;
+}
+
+void VChip8Debugger::unwatch_register(unsigned int index){
+    this->register_mask &= ~(1u << (index & 0xF));
+}
+
+bool VChip8Debugger::armed() const{
+    return this->breakpoint_count > 0 || this->watchpoint_count > 0 || this->register_mask != 0;
+}
+
+uint64_t VChip8Debugger::frame() const{
+    return this->frames;
+}
+
+unsigned int VChip8Debugger::frame_position() const{
+    return this->position;
+}
+
+bool VChip8Debugger::writes_watched(uint16_t pc, uint16_t& address) const{
+    //only these store to memory, all at I
+    size_t mask = this->chip8.memory_size() - 1;
+    VChip8::Instruction instr = this->chip8.decode((this->chip8.memory[pc & mask] << 8u) | this->chip8.memory[(pc + 1u) & mask]);
+    unsigned int length;
+    switch (instr.id)
+    {
+    case VChip8::ID_Fx33:
+        length = 3;
+        break;
+    case VChip8::ID_Fx55:
+        length = instr.x + 1u;
+        break;
+    case VChip8::ID_5xy2:
+        length = (instr.x > instr.y ? instr.x - instr.y : instr.y - instr.x) + 1u;
+        break;
+    default:
+        return false;
+    }
+    for (unsigned int i = 0; i < length; i++){
+        uint16_t written = (uint16_t)((this->chip8.index_register + i) & mask);
+        if (test(this->watchpoints, written)){
+            address = written;
+            return true;
+        }
+    }
+    return false;
+}
+
+VChip8Debugger::Stop VChip8Debugger::execute(uint64_t budget){
+    Stop stop;
+    bool resumed = true; //a breakpoint on the first instruction is the one we stopped on
+    uint64_t done = 0;
+    while (done < budget && this->chip8.get_error_code() == VChip8::ALL_OKAY){
+        unsigned int left = this->instructions_per_frame - this->position;
+        if (!armed()){
+            //nothing to check, the rest of the frame in one call
+            unsigned int batch = budget - done < left ? (unsigned int)(budget - done) : left;
+            unsigned int executed = this->run_core(this->core, batch);
+            //fewer means halted on Fx0A (or stopped), the frame is over either way
+            this->position = executed < batch ? this->instructions_per_frame : this->position + batch;
+            done += batch;
+        }
+        else{
+            uint16_t pc = this->chip8.program_counter;
+            if (!resumed && test(this->breakpoints, pc)){
+                stop.reason = STOP_BREAKPOINT;
+                stop.address = pc;
+                return stop;
+            }
+            resumed = false;
+
+            uint16_t written = 0;
+            bool watched = this->watchpoint_count > 0 && writes_watched(pc, written);
+            uint8_t before[16];
+            memcpy(before, this->chip8.registers, sizeof(before));
+
+            unsigned int executed = this->run_core(this->core, 1);
+            this->position = executed ? this->position + 1 : this->instructions_per_frame;
+            ++done;
+
+            if (this->chip8.get_error_code() == VChip8::ALL_OKAY && executed){
+                if (watched){
+                    stop.reason = STOP_WATCHPOINT;
+                    stop.address = pc;
+                    stop.target = written;
+                }
+                for (unsigned int r = 0; r < 16 && stop.reason == STOP_NONE; r++){
+                    if (!((this->register_mask >> r) & 1u) || before[r] == this->chip8.registers[r])
+                        continue;
+                    if (this->register_values[r] == ANY_VALUE || this->register_values[r] == this->chip8.registers[r]){
+                        stop.reason = STOP_REGISTER;
+                        stop.address = pc;
+                        stop.target = (uint16_t)r;
+                    }
+                }
+            }
+        }
+
+        if (this->position == this->instructions_per_frame){
+            this->chip8.tick_timers();
+            ++this->frames;
+            this->position = 0;
+        }
+        if (stop.reason != STOP_NONE)
+            return stop;
+    }
+    if (this->chip8.get_error_code() != VChip8::ALL_OKAY){
+        stop.reason = STOP_MACHINE;
+        stop.address = this->chip8.program_counter;
+    }
+    return stop;
+}
+
+VChip8Debugger::Stop VChip8Debugger::step(uint64_t instructions){
+    //stepping checks nothing but the instructions it was asked for
+    uint64_t breakpointMap[MAP_WORDS];
+    unsigned int breakpointCount = this->breakpoint_count;
+    memcpy(breakpointMap, this->breakpoints, sizeof(breakpointMap));
+    memset(this->breakpoints, 0, sizeof(this->breakpoints));
+    this->breakpoint_count = 0;
+    uint16_t registerMask = this->register_mask;
+    unsigned int watchpointCount = this->watchpoint_count;
+    this->register_mask = 0;
+    this->watchpoint_count = 0;
+    //one at a time, a halted machine takes up a whole frame per step
+    Stop stop;
+    for (uint64_t i = 0; i < instructions && stop.reason == STOP_NONE; i++){
+        if (this->chip8.get_error_code() != VChip8::ALL_OKAY)
+            break;
+        unsigned int executed = this->run_core(this->core, 1);
+        this->position = executed ? this->position + 1 : this->instructions_per_frame;
+        if (this->position == this->instructions_per_frame){
+            this->chip8.tick_timers();
+            ++this->frames;
+            this->position = 0;
+        }
+    }
+    if (this->chip8.get_error_code() != VChip8::ALL_OKAY){
+        stop.reason = STOP_MACHINE;
+        stop.address = this->chip8.program_counter;
+    }
+    memcpy(this->breakpoints, breakpointMap, sizeof(breakpointMap));
+    this->breakpoint_count = breakpointCount;
+    this->register_mask = registerMask;
+    this->watchpoint_count = watchpointCount;
+    return stop;
+}
+
+VChip8Debugger::Stop VChip8Debugger::run_frames(uint64_t count){
+    //up to the end of the count'th frame boundary from here
+    return execute(count * this->instructions_per_frame - this->position);
+}
+
+VChip8Debugger::Stop VChip8Debugger::run_to(uint16_t address, uint64_t count){
+    //a breakpoint for as long as the run takes
+    bool existing = test(this->breakpoints, address);
+    set_breakpoint(address, true);
+    Stop stop = run_frames(count);
+    set_breakpoint(address, existing);
+    return stop;
+}
+
+std::string VChip8Debugger::disassemble(uint16_t address) const{
+    size_t mask = this->chip8.memory_size() - 1;
+    uint16_t opcode = (uint16_t)((this->chip8.memory[address & mask] << 8u) | this->chip8.memory[(address + 1u) & mask]);
+    VChip8::Instruction instr = this->chip8.decode(opcode);
+
+    std::ostringstream out;
+    out << std::uppercase << std::hex << std::setfill('0') << std::setw(4) << opcode << "  ";
+    for (const char* c = mnemonics[instr.id]; *c; c++){
+        if (*c != '%' || !c[1]){
+            out << *c;
+            continue;
+        }
+        switch (*++c)
+        {
+        case 'x': out << (unsigned int)instr.x; break;
+        case 'y': out << (unsigned int)instr.y; break;
+        case 'n': out << std::dec << (unsigned int)instr.n << std::hex; break;
+        case 'k': out << "0x" << std::setw(2) << (unsigned int)instr.kk; break;
+        case 'a': out << "0x" << std::setw(3) << instr.nnn; break;
+        case 'w':
+            out << "0x" << std::setw(4) << ((this->chip8.memory[(address + 2u) & mask] << 8u) | this->chip8.memory[(address + 3u) & mask]);
+            break;
+        }
+    }
+    return out.str();
+}
+
+void VChip8Debugger::report(const Stop& stop, std::ostream& out){
+    out << std::uppercase << std::hex << std::setfill('0');
+    switch (stop.reason)
+    {
+    case STOP_NONE:
+        out << "stopped";
+        break;
+    case STOP_BREAKPOINT:
+        out << "breakpoint 0x" << std::setw(3) << stop.address;
+        break;
+    case STOP_WATCHPOINT:
+        out << "watchpoint 0x" << std::setw(3) << stop.target << " written at 0x" << std::setw(3) << stop.address;
+        break;
+    case STOP_REGISTER:
+        out << "register V" << stop.target << " = 0x" << std::setw(2) << (unsigned int)this->chip8.registers[stop.target]
+            << " at 0x" << std::setw(3) << stop.address;
+        break;
+    case STOP_MACHINE:
+        out << "machine stopped: " << this->chip8.get_error_name();
+        break;
+    }
+    out << ", frame " << std::dec << this->frames << (this->chip8.halted ? ", waiting for a key" : "") << "\n"
+        << "=> 0x" << std::hex << std::setw(3) << this->chip8.program_counter << "  " << disassemble(this->chip8.program_counter) << "\n";
+}
+
+bool VChip8Debugger::command(const std::string& line, std::ostream& out){
+    std::istringstream in(line);
+    std::string name;
+    if (!(in >> name)){
+        out << "ok\n";
+        return true;
+    }
+
+    unsigned long address = 0, value = 0;
+    unsigned long long count = 0;
+    unsigned int index = 0;
+    bool valid = true;
+    if (name == "quit"){
+        out << "ok\n";
+        return false;
+    }
+    else if (name == "help")
+        out << help_text;
+    else if (name == "break" || name == "delete"){
+        valid = parse_hex(in, address);
+        if (valid)
+            set_breakpoint((uint16_t)address, name == "break");
+    }
+    else if (name == "watch" || name == "unwatch"){
+        valid = parse_hex(in, address);
+        if (valid && !parse_hex(in, value))
+            value = 1;
+        if (valid)
+            set_watchpoint((uint16_t)address, (uint16_t)value, name == "watch");
+    }
+    else if (name == "reg"){
+        valid = parse_register(in, index);
+        if (valid)
+            watch_register(index, parse_hex(in, value) ? (int)(value & 0xFF) : ANY_VALUE);
+    }
+    else if (name == "unreg"){
+        valid = parse_register(in, index);
+        if (valid)
+            unwatch_register(index);
+    }
+    else if (name == "step")
+        report(step(parse_count(in, count) ? count : 1), out);
+    else if (name == "continue")
+        report(run_frames(parse_count(in, count) ? count : DEFAULT_FRAMES), out);
+    else if (name == "until"){
+        valid = parse_hex(in, address);
+        if (valid)
+            report(run_to((uint16_t)address, parse_count(in, count) ? count : DEFAULT_FRAMES), out);
+    }
+    else if (name == "regs"){
+        out << std::uppercase << std::hex << std::setfill('0');
+        for (unsigned int r = 0; r < 16; r++)
+            out << "V" << r << "=" << std::setw(2) << (unsigned int)this->chip8.registers[r] << (r % 8 == 7 ? "\n" : " ");
+        out << "I=" << std::setw(4) << this->chip8.index_register << " PC=" << std::setw(4) << this->chip8.program_counter
+            << " SP=" << std::setw(2) << (unsigned int)this->chip8.stack_pointer << " DT=" << std::setw(2) << (unsigned int)this->chip8.delay_timer
+            << " ST=" << std::setw(2) << (unsigned int)this->chip8.sound_timer << std::dec << " frame=" << this->frames
+            << "+" << this->position << (this->chip8.halted ? " halted" : "") << "\n";
+    }
+    else if (name == "mem"){
+        valid = parse_hex(in, address);
+        if (valid && !parse_hex(in, value))
+            value = 16;
+        size_t mask = this->chip8.memory_size() - 1;
+        out << std::uppercase << std::hex << std::setfill('0');
+        for (unsigned long i = 0; valid && i < value; i++){
+            if (i % 16 == 0)
+                out << (i ? "\n" : "") << std::setw(4) << ((address + i) & mask) << ":";
+            out << " " << std::setw(2) << (unsigned int)this->chip8.memory[(address + i) & mask];
+        }
+        if (valid && value)
+            out << "\n";
+    }
+    else if (name == "dis"){
+        //context around the program counter unless an address is given
+        size_t start = this->chip8.program_counter >= 8 ? this->chip8.program_counter - 8u : 0;
+        if (parse_hex(in, address))
+            start = address;
+        if (!parse_count(in, count))
+            count = 10;
+        size_t mask = this->chip8.memory_size() - 1;
+        out << std::uppercase << std::hex << std::setfill('0');
+        for (unsigned long long i = 0; i < count; i++){
+            uint16_t at = (uint16_t)((start + 2 * i) & mask);
+            out << (at == this->chip8.program_counter ? "=>" : "  ") << (test(this->breakpoints, at) ? "*" : " ")
+                << "0x" << std::setw(3) << at << "  " << disassemble(at) << "\n";
+        }
+    }
+    else if (name == "keys"){
+        //bit k is key k
+        valid = parse_hex(in, value);
+        for (unsigned int k = 0; valid && k < 16; k++)
+            this->chip8.keypad[k] = (value >> k) & 1u;
+    }
+    else{
+        out << "error unknown command " << name << ", try help\n";
+        return true;
+    }
+
+    out << (valid ? "ok\n" : "error bad arguments, try help\n");
+    return true;
+}
+
+void VChip8Debugger::serve(FILE* in, FILE* out){
+    char buffer[256];
+    bool running = true;
+    while (running && std::fgets(buffer, sizeof(buffer), in)){
+        std::ostringstream reply;
+        running = command(buffer, reply);
+        std::fputs(reply.str().c_str(), out);
+        std::fflush(out);
+    }
+}
+
+bool VChip8Debugger::serve_tcp(unsigned short port){
+#ifdef VCHIP8_DEBUG_SOCKETS
+    //local connections only, the protocol can rewrite memory
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || listen(listener, 1) != 0){
+        close(listener);
+        return false;
+    }
+    int client = accept(listener, nullptr, nullptr);
+    close(listener);
+    if (client < 0)
+        return false;
+
+    //one stream each way, closing both closes the socket once
+    FILE* in = fdopen(client, "r");
+    FILE* out = in ? fdopen(dup(client), "w") : nullptr;
+    if (!in || !out){
+        if (in)
+            std::fclose(in);
+        else
+            close(client);
+        return false;
+    }
+    serve(in, out);
+    std::fclose(out);
+    std::fclose(in);
+    return true;
+#else
+    (void)port;
+    return false;
+#endif
+}
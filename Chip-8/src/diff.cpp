@@ -0,0 +1,247 @@
+#include "../include/chip_8.hpp"
+#include "../include/jit.hpp"
+#include "../include/lockstep.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//differential checker: runs randomly generated CHIP-8 ROMs on the engines that skip or reorder work
+//and compares them frame by frame with an engine that steps one instruction at a time
+//    idle      run() with idle loop fast-forwarding, masked and checked bounds, against cycle()
+//    jit       VChip8Jit against cycle()
+//    lockstep  VChip8Lockstep lanes against independent VChip8 instances with the same seed and keys
+//ROM n is generated from seed + n, a mismatch is reproduced with --seed <its seed> --roms 1.
+
+namespace {
+
+    //a CHIP-8 program of random instructions mixed with idle loops that wait on the delay timer
+    //or the keypad; self-modifying ones point I at the code and store over it
+    std::vector<uint8_t> random_rom(std::mt19937& random, bool self_modifying){
+        unsigned int words = 64 + random() % 448;
+        auto target = [&](){ return 0x200u + 2u * (random() % words); };
+        std::vector<uint16_t> code;
+        while (code.size() < words){
+            uint16_t here = (uint16_t)(0x200 + 2 * code.size());
+            unsigned int x = random() % 16, y = random() % 16, kk = random() % 256;
+            switch (random() % 32)
+            {
+            case 0: //wait for the delay timer
+                code.push_back(0x6000 | x << 8 | (random() % 8));
+                code.push_back(0xF015 | x << 8);
+                code.push_back(0xF007 | x << 8);
+                code.push_back(0x3000 | x << 8);
+                code.push_back(0x1000 | (here + 4));
+                break;
+            case 1: //wait for a key
+                code.push_back(0xE09E | x << 8);
+                code.push_back(0x1000 | here);
+                break;
+            case 2: code.push_back(0x1000 | target()); break;
+            case 3: code.push_back(0x2000 | target()); break;
+            case 4: code.push_back(0x00EE); break;
+            case 5: code.push_back(0x3000 | x << 8 | kk); break;
+            case 6: code.push_back(0x4000 | x << 8 | kk); break;
+            case 7: code.push_back(0x5000 | x << 8 | y << 4); break;
+            case 8: case 9: code.push_back(0x6000 | x << 8 | kk); break;
+            case 10: case 11: code.push_back(0x7000 | x << 8 | kk); break;
+            case 12: case 13: case 14:
+            {
+                static const uint8_t alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+                code.push_back(0x8000 | x << 8 | y << 4 | alu[random() % sizeof(alu)]);
+                break;
+            }
+            case 15: code.push_back(0x9000 | x << 8 | y << 4); break;
+            case 16: code.push_back(0xA000 | (self_modifying ? target() : 0xA00 + random() % 0x500)); break;
+            case 17: code.push_back(0xB000 | (0x200 + random() % 0x100)); break;
+            case 18: code.push_back(0xC000 | x << 8 | kk); break;
+            case 19: code.push_back(0xD000 | x << 8 | y << 4 | (random() % 16)); break;
+            case 20: code.push_back(0xE09E | x << 8); break;
+            case 21: code.push_back(0xE0A1 | x << 8); break;
+            case 22: code.push_back(0xF007 | x << 8); break;
+            case 23: code.push_back(0xF00A | x << 8); break;
+            case 24: code.push_back(0xF015 | x << 8); break;
+            case 25: code.push_back(0xF018 | x << 8); break;
+            case 26: code.push_back(0xF01E | x << 8); break;
+            case 27: code.push_back(0xF029 | x << 8); break;
+            case 28: code.push_back(0xF033 | x << 8); break;
+            case 29: code.push_back(0xF055 | x << 8); break;
+            case 30: code.push_back(0xF065 | x << 8); break;
+            default: code.push_back(0x00E0); break;
+            }
+        }
+        code.resize(words);
+
+        std::vector<uint8_t> rom;
+        for (uint16_t word : code){
+            rom.push_back((uint8_t)(word >> 8));
+            rom.push_back((uint8_t)word);
+        }
+        return rom;
+    }
+
+    //a key pattern that changes every few frames and differs between machines
+    void press_keys(uint8_t* keypad, uint64_t frame, unsigned int machine){
+        std::memset(keypad, 0, 16);
+        unsigned int key = (unsigned int)((frame / 7 + machine * 5) % 23);
+        if (key < 16)
+            keypad[key] = 1;
+    }
+
+    //everything a Snapshot holds, compared in place since every lane is checked after every frame;
+    //memory only up to the mode's size, set_mode() keeps the rest zeroed
+    bool same_state(VChip8Machine& a, VChip8Machine& b){
+        return a.get_mode() == b.get_mode() && a.get_error_code() == b.get_error_code() &&
+               std::memcmp(a.memory, b.memory, a.memory_size()) == 0 &&
+               std::memcmp(a.video_memory, b.video_memory, sizeof(a.video_memory)) == 0 &&
+               std::memcmp(a.stack, b.stack, sizeof(a.stack)) == 0 &&
+               std::memcmp(a.registers, b.registers, sizeof(a.registers)) == 0 &&
+               std::memcmp(a.flag_registers, b.flag_registers, sizeof(a.flag_registers)) == 0 &&
+               std::memcmp(a.audio_pattern, b.audio_pattern, sizeof(a.audio_pattern)) == 0 &&
+               a.index_register == b.index_register && a.program_counter == b.program_counter &&
+               a.stack_pointer == b.stack_pointer && a.delay_timer == b.delay_timer &&
+               a.sound_timer == b.sound_timer && a.hires == b.hires && a.plane_mask == b.plane_mask &&
+               a.pitch == b.pitch && a.halted == b.halted && a.randGen == b.randGen;
+    }
+
+    //one frame stepped with cycle(), the reference for run_frame()
+    template<class Core>
+    unsigned int step_frame(Core& chip8, unsigned int instructions){
+        unsigned int executed = 0;
+        if (chip8.wake()){
+            while (executed < instructions && chip8.get_error_code() == VChip8::ALL_OKAY && !chip8.halted){
+                chip8.cycle();
+                ++executed;
+            }
+        }
+        chip8.tick_timers();
+        return executed;
+    }
+
+    //false and the frame of the first difference if run_frame(), which skips idle loops, and stepping disagree
+    template<class Core>
+    bool check_idle(const std::vector<uint8_t>& rom, uint32_t seed, unsigned int instructions, uint64_t frames, uint64_t& frame){
+        Core fast(seed), stepped(seed);
+        fast.loadRom(rom.data(), rom.size());
+        stepped.loadRom(rom.data(), rom.size());
+        for (frame = 0; frame < frames; frame++){
+            press_keys(fast.keypad, frame, 0);
+            press_keys(stepped.keypad, frame, 0);
+            if (fast.run_frame(instructions) != step_frame(stepped, instructions) || !same_state(fast, stepped))
+                return false;
+        }
+        return true;
+    }
+
+    //false and the frame of the first difference if the JIT and stepping disagree
+    bool check_jit(const std::vector<uint8_t>& rom, uint32_t seed, unsigned int instructions, uint64_t frames, uint64_t& frame){
+        VChip8 translated(seed), stepped(seed);
+        translated.loadRom(rom.data(), rom.size());
+        stepped.loadRom(rom.data(), rom.size());
+        VChip8Jit jit(translated);
+        for (frame = 0; frame < frames; frame++){
+            press_keys(translated.keypad, frame, 0);
+            press_keys(stepped.keypad, frame, 0);
+            if (jit.run_frame(instructions) != step_frame(stepped, instructions) || !same_state(translated, stepped))
+                return false;
+        }
+        return true;
+    }
+
+    //false and the frame of the first difference if a lane and its independent instance disagree
+    bool check_lockstep(const std::vector<uint8_t>& rom, unsigned int lanes, unsigned int instructions, uint64_t frames, uint64_t& frame){
+        VChip8Lockstep engine(lanes);
+        std::vector<VChip8> independent;
+        independent.reserve(lanes);
+        for (unsigned int l = 0; l < lanes; l++){
+            engine.machine(l).randGen.seed(l);
+            independent.emplace_back(l);
+            independent[l].loadRom(rom.data(), rom.size());
+        }
+        engine.loadRom(rom.data(), rom.size());
+        for (frame = 0; frame < frames; frame++){
+            uint64_t expected = 0;
+            for (unsigned int l = 0; l < lanes; l++){
+                press_keys(engine.machine(l).keypad, frame, l);
+                press_keys(independent[l].keypad, frame, l);
+                expected += independent[l].run_frame(instructions);
+            }
+            if (engine.run_frame(instructions) != expected)
+                return false;
+            //the lanes' registers are only current in their VChip8 after store_lanes()
+            engine.store_lanes();
+            for (unsigned int l = 0; l < lanes; l++){
+                if (!same_state(engine.machine(l), independent[l]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    [[noreturn]] void usage(const char* program){
+        std::fprintf(stderr, "Usage: %s [--roms N] [--frames N] [--seed N] [--lanes N]\n"
+                             "  --roms N    random ROMs to check (default 100)\n"
+                             "  --frames N  frames every ROM runs (default 300)\n"
+                             "  --seed N    seed of the first ROM (default 1)\n"
+                             "  --lanes N   lockstep lanes (default 33, one more than a vector group)\n", program);
+        std::exit(EXIT_FAILURE);
+    }
+
+}
+
+int main(int argc, char** argv){
+
+    unsigned int roms = 100;
+    uint64_t frames = 300;
+    uint32_t seed = 1;
+    unsigned int lanes = 33;
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        else if (std::strcmp(argv[i], "--roms") == 0)
+            roms = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--frames") == 0)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0)
+            seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--lanes") == 0)
+            lanes = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else
+            usage(argv[0]);
+    }
+    if (lanes == 0)
+        usage(argv[0]);
+
+    auto startTime = std::chrono::steady_clock::now();
+    unsigned int mismatches = 0;
+    for (unsigned int n = 0; n < roms; n++){
+        uint32_t romSeed = seed + n;
+        std::mt19937 random(romSeed);
+        std::vector<uint8_t> rom = random_rom(random, n % 2 == 1);
+        unsigned int instructions = 1 + random() % 300;
+
+        auto report = [&](const char* check, uint64_t frame){
+            std::printf("MISMATCH %s: seed %u, %u instructions per frame, frame %llu\n", check, romSeed, instructions,
+                        (unsigned long long)frame);
+            ++mismatches;
+        };
+        uint64_t frame;
+        if (!check_idle<VChip8>(rom, romSeed, instructions, frames, frame))
+            report("idle (masked)", frame);
+        if (!check_idle<VChip8Core<VChip8Quirks, VChip8BoundsChecked>>(rom, romSeed, instructions, frames, frame))
+            report("idle (checked)", frame);
+        if (!check_jit(rom, romSeed, instructions, frames, frame))
+            report("jit", frame);
+        if (!check_lockstep(rom, lanes, instructions, frames, frame))
+            report("lockstep", frame);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::printf("roms:              %u\n"
+                "mismatches:        %u\n"
+                "seconds:           %.6f\n",
+                roms, mismatches, seconds);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
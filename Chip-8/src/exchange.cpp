@@ -0,0 +1,50 @@
+#include "../include/exchange.hpp"
+#include <cstring>
+
+void VChip8Frame::capture(const VChip8Machine& chip8, uint64_t number){
+    std::memcpy(this->video_memory, chip8.video_memory, sizeof(this->video_memory));
+    this->number = number;
+    this->mode = chip8.get_mode();
+    this->hires = chip8.hires;
+}
+
+VChip8TripleBuffer::VChip8TripleBuffer(){
+    std::memset(this->slots, 0, sizeof(this->slots));
+}
+
+VChip8Frame& VChip8TripleBuffer::back(){
+    return this->slots[this->back_slot];
+}
+
+void VChip8TripleBuffer::publish(){
+    //release makes the frame visible with the index, acquire hands back a slot the consumer is done with
+    uint8_t previous = this->shared.exchange(this->back_slot | FRESH, std::memory_order_acq_rel);
+    this->back_slot = previous & INDEX;
+}
+
+bool VChip8TripleBuffer::acquire(){
+    if (!(this->shared.load(std::memory_order_relaxed) & FRESH))
+        return false;
+    uint8_t previous = this->shared.exchange(this->front_slot, std::memory_order_acq_rel);
+    this->front_slot = previous & INDEX;
+    return true;
+}
+
+const VChip8Frame& VChip8TripleBuffer::front() const{
+    return this->slots[this->front_slot];
+}
+
+void VChip8SharedKeypad::store(const uint8_t* keypad){
+    uint16_t bits = 0;
+    for (unsigned int k = 0; k < 16; k++){
+        if (keypad[k])
+            bits |= 1u << k;
+    }
+    this->keys.store(bits, std::memory_order_relaxed);
+}
+
+void VChip8SharedKeypad::load(uint8_t* keypad) const{
+    uint16_t bits = this->keys.load(std::memory_order_relaxed);
+    for (unsigned int k = 0; k < 16; k++)
+        keypad[k] = (bits >> k) & 1u;
+}
@@ -0,0 +1,508 @@
+#include "../include/chip_8.hpp"
+#include "../include/jit.hpp"
+#include "../include/aot.hpp"
+#include "../include/runner.hpp"
+#include "../include/lockstep.hpp"
+#include "../include/movie.hpp"
+#include "../include/audio.hpp"
+#include "../include/pacer.hpp"
+#include "../include/capture.hpp"
+#include "../include/debugger.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+//Headless batch driver: runs a ROM as fast as the host allows for a fixed
+//instruction (or frame) budget and reports throughput plus a framebuffer hash.
+
+static void usage(const char* program){
+	std::cerr << "Usage: " << program << " <ROM> [--instructions N | --frames N] [--ipf N] [--jit | --aot] [--mode MODE] [--quirks PROFILE] [--checked] [--no-idle-skip] [--seed N] [--replay MOVIE] [--hashes FILE] [--wav FILE] [--capture FILE] [--realtime] [--profile PREFIX]\n"
+	          << "       " << program << " <ROM> [--ipf N] [--mode MODE] [--quirks PROFILE] [--checked] [--seed N] --debug | --debug-port N\n"
+	          << "       " << program << " <ROM> [--instructions N | --frames N] [--ipf N] [--mode MODE] [--seed N] [--replay MOVIE] --instances N [--threads N | --lockstep]\n"
+	          << "  --instructions N  execute N instructions (default 10000000)\n"
+	          << "  --frames N        execute N frames of --ipf instructions each\n"
+	          << "  --ipf N           instructions per 60Hz frame, timers tick once per frame (default 10)\n"
+	          << "  --jit             use the x86-64 dynamic recompiler when available\n"
+	          << "  --aot             use the code compiled ahead of time into this binary for the ROM\n"
+	          << "                    (see VCHIP8_AOT_ROMS), the interpreter runs anything else\n"
+	          << "  --mode MODE       chip8 (default), schip or xochip, the JIT, AOT and lockstep engines\n"
+	          << "                    run CHIP-8 only and use the interpreter in the other modes\n"
+	          << "  --quirks PROFILE  default, vip (COSMAC VIP), schip (SUPER-CHIP 1.1) or octo, see chip_8.hpp\n"
+	          << "  --checked         stop on stack overflow/underflow and memory accesses past the end instead of\n"
+	          << "                    wrapping, the JIT and AOT engines run only the default profile without it\n"
+	          << "  --no-idle-skip    execute every pass of loops that only wait for the timers instead of\n"
+	          << "                    counting them, same results, for measuring (interpreter only)\n"
+	          << "  --seed N          random number seed, instance i gets N + i (default 0)\n"
+	          << "  --replay MOVIE    feed the keypad from a movie recorded by VChip8 --record, its seed, mode and\n"
+	          << "                    instructions per frame are used and --frames defaults to its length\n"
+	          << "  --hashes FILE     write the state and framebuffer hash of every frame to FILE\n"
+	          << "  --wav FILE        write the sound of every frame to FILE as 44.1kHz 16-bit mono PCM\n"
+	          << "  --capture FILE    write every frame that changed the display to FILE\n"
+	          << "  --capture-format FORMAT\n"
+	          << "                    raw (RGBA bytes), y4m or png (FILE is then a pattern like shots/%06u.png),\n"
+	          << "                    by default png for .png, raw for .raw or .rgba and y4m for anything else\n"
+	          << "  --scale SCALER    nearest:N (default nearest:1), epx or scanlines:N for the captured frames\n"
+	          << "  --capture-all     encode frames identical to the one before again instead of repeating the\n"
+	          << "                    previous frame's bytes (raw, y4m) or skipping them (png)\n"
+	          << "  --realtime        pace frames at 60Hz like VChip8 does and report the timing\n"
+	          << "  --profile PREFIX  write PREFIX.json and PREFIX.folded (needs a VCHIP8_PROFILE build)\n"
+	          << "  --debug           run the ROM under the debugger, commands on stdin and replies on stdout\n"
+	          << "                    (type help), see debugger.hpp\n"
+	          << "  --debug-port N    the same for one client connecting to 127.0.0.1:N\n"
+	          << "  --instances N     run N copies of the ROM on the work-stealing runner\n"
+	          << "  --threads N       runner worker threads (default one per hardware thread)\n"
+	          << "  --lockstep        run the instances on one thread with the SIMD lockstep engine instead\n";
+	std::exit(EXIT_FAILURE);
+}
+
+//prints the summary shared by the multi-instance modes
+static void print_instances(unsigned int instances, unsigned int threads, unsigned long long failed,
+                            unsigned long long executed, unsigned long long frameCount, double seconds, uint64_t combinedHash){
+	std::cout << "instances:         " << instances << "\n"
+	          << "threads:           " << threads << "\n"
+	          << "failed instances:  " << failed << "\n"
+	          << "instructions:      " << executed << "\n"
+	          << "frames:            " << frameCount << "\n"
+	          << "seconds:           " << std::fixed << std::setprecision(6) << seconds << "\n"
+	          << "instructions/sec:  " << std::setprecision(0) << (seconds > 0 ? executed / seconds : 0.0) << "\n"
+	          << "frames/sec:        " << (seconds > 0 ? frameCount / seconds : 0.0) << "\n"
+	          << "combined hash:     0x" << std::hex << std::setw(16) << std::setfill('0') << combinedHash << "\n";
+}
+
+//runs all instances as lanes of one VChip8Lockstep, frames advance together
+static int run_lockstep(char const* romFilename, unsigned int instances, VChip8::Mode mode, uint32_t seed,
+                        unsigned long long frames, unsigned int instructionsPerFrame, const VChip8Movie* movie){
+
+	VChip8Lockstep engine(instances);
+	for (unsigned int i = 0; i < instances; i++)
+		engine.machine(i).randGen.seed(seed + i);
+	//the other lanes copy the first one's mode in loadRom
+	engine.machine(0).set_mode(mode);
+	engine.loadRom(romFilename);
+	if (engine.get_error_code(0) != VChip8::ALL_OKAY){
+		std::cerr << engine.machine(0).get_error_name() << "\n";
+		return -1;
+	}
+
+	unsigned long long executed = 0;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	VChip8Movie input = movie ? *movie : VChip8Movie();
+	for (unsigned long long frame = 0; frame < frames; frame++){
+		if (movie){
+			for (unsigned int i = 0; i < instances; i++)
+				input.apply(frame, engine.machine(i).keypad);
+		}
+		executed += engine.run_frame(instructionsPerFrame);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+	unsigned long long failed = 0;
+	uint64_t combinedHash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < instances; i++){
+		failed += engine.get_error_code(i) != VChip8::ALL_OKAY && engine.get_error_code(i) != VChip8::PROGRAM_EXITED;
+		combinedHash = (combinedHash ^ engine.machine(i).get_frame_hash()) * 1099511628211ull;
+	}
+
+	print_instances(instances, 1, failed, executed, frames * instances, seconds, combinedHash);
+	return failed == 0 ? 0 : -1;
+}
+
+//runs many instances of the ROM in-process, every instance gets its own RNG seed
+static int run_instances(char const* romFilename, unsigned int instances, unsigned int threads, VChip8::Mode mode, uint32_t seed,
+                         unsigned long long frames, unsigned int instructionsPerFrame, bool compiled, bool lockstep,
+                         const VChip8Movie* movie){
+
+	if (compiled)
+		std::cerr << "--jit and --aot are ignored with --instances, the runner uses the interpreter\n";
+
+	if (lockstep)
+		return run_lockstep(romFilename, instances, mode, seed, frames, instructionsPerFrame, movie);
+
+	VChip8Runner runner(threads);
+	for (unsigned int i = 0; i < instances; i++){
+		VChip8& chip8 = runner.add();
+		chip8.randGen.seed(seed + i);
+		chip8.set_mode(mode);
+		chip8.loadRom(romFilename);
+		if (chip8.get_error_code() != VChip8::ALL_OKAY){
+			std::cerr << chip8.get_error_name() << "\n";
+			return -1;
+		}
+		if (movie)
+			runner.set_input(i, *movie);
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	runner.run(frames, instructionsPerFrame);
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+	//order-dependent combination of the per-instance hashes
+	unsigned long long executed = 0, frameCount = 0, parked = 0, failed = 0;
+	uint64_t combinedHash = 14695981039346656037ull;
+	for (const VChip8Runner::Result& result : runner.results()){
+		executed += result.instructions;
+		frameCount += result.frames;
+		parked += result.parked_frames;
+		failed += result.error_code != VChip8::ALL_OKAY && result.error_code != VChip8::PROGRAM_EXITED;
+		combinedHash = (combinedHash ^ result.frame_hash) * 1099511628211ull;
+	}
+
+	print_instances(instances, runner.thread_count() < instances ? runner.thread_count() : instances,
+	                failed, executed, frameCount, seconds, combinedHash);
+	std::cout << "parked frames:     " << std::dec << parked << "\n";
+
+	return failed == 0 ? 0 : -1;
+}
+
+//what the single-instance run takes from the command line
+struct Settings{
+	char const* romFilename = nullptr;
+	unsigned long long instructions = 10000000ull;
+	unsigned int instructionsPerFrame = 10;
+	bool useJit = false;
+	bool useAot = false;
+	bool realtime = false;
+	bool skipIdleLoops = true;
+	bool debug = false;
+	unsigned int debugPort = 0; //serve the debugger on a socket instead of stdin/stdout
+	VChip8::Mode mode = VChip8::MODE_CHIP8;
+	uint32_t seed = 0;
+	char const* hashesFilename = nullptr;
+	char const* wavFilename = nullptr;
+	char const* profilePrefix = nullptr;
+	char const* captureFilename = nullptr;
+	bool captureFormatGiven = false;
+	VChip8Capture::Options captureOptions;
+};
+
+//runs one instance with the quirk and bounds policies of Machine, see chip_8.hpp points 16 and 17
+template<class Machine>
+static int run_single(const Settings& settings, VChip8Movie* movie){
+
+	Machine chip8(settings.seed);
+	chip8.skip_idle_loops = settings.skipIdleLoops;
+	chip8.set_mode(settings.mode);
+	chip8.loadRom(settings.romFilename);
+
+	if (chip8.get_error_code() != VChip8::ALL_OKAY){
+		std::cerr << chip8.get_error_name() << "\n";
+		return -1;
+	}
+
+	//the debugger keeps its own frame clock and runs until it is quit
+	if (settings.debug){
+		VChip8Debugger debugger(chip8, settings.instructionsPerFrame);
+		if (settings.debugPort == 0)
+			debugger.serve(stdin, stdout);
+		else if (!debugger.serve_tcp((unsigned short)settings.debugPort)){
+			std::cerr << "Couldn't serve the debugger on port " << settings.debugPort << "\n";
+			return -1;
+		}
+		return chip8.get_error_code() == VChip8::ALL_OKAY || chip8.get_error_code() == VChip8::PROGRAM_EXITED ? 0 : -1;
+	}
+
+	std::ofstream hashes;
+	if (settings.hashesFilename){
+		hashes.open(settings.hashesFilename, std::ios::out | std::ios::trunc);
+		if (!hashes.is_open()){
+			std::cerr << "Couldn't write " << settings.hashesFilename << "\n";
+			return -1;
+		}
+		hashes << std::hex << std::setfill('0');
+	}
+
+	//the frames go through the same ring and synth as VChip8's audio device, one frame pushed and
+	//rendered at a time so the file doesn't depend on timing
+	VChip8AudioRing audioRing;
+	VChip8AudioSynth synth(audioRing);
+	VChip8WavFile wav;
+	std::vector<int16_t> samples(synth.max_frame_samples());
+	if (settings.wavFilename && !wav.open(settings.wavFilename, synth.get_sample_rate())){
+		std::cerr << "Couldn't write " << settings.wavFilename << "\n";
+		return -1;
+	}
+
+	//a batch run keeps every frame, a paced one would rather drop frames than fall behind
+	VChip8Capture capture;
+	VChip8Capture::Options captureOptions = settings.captureOptions;
+	if (settings.captureFilename){
+		if (!settings.captureFormatGiven)
+			captureOptions.format = VChip8Capture::format_for(settings.captureFilename);
+		captureOptions.block_when_full = !settings.realtime;
+		captureOptions.mode = settings.mode;
+		if (!capture.open(settings.captureFilename, captureOptions)){
+			std::cerr << "Couldn't write " << settings.captureFilename << "\n";
+			return -1;
+		}
+	}
+
+	//the JIT and the compiled ROMs implement VChip8 alone, the other profiles are interpreted
+	std::unique_ptr<VChip8Jit> jit;
+	std::unique_ptr<VChip8AotRunner> aot;
+	if constexpr (std::is_same<Machine, VChip8>::value){
+		if (settings.useJit){
+			jit.reset(new VChip8Jit(chip8));
+			if (!jit->available())
+				std::cerr << "JIT not available on this host, using the interpreter\n";
+		}
+		if (settings.useAot){
+			aot.reset(new VChip8AotRunner(chip8));
+			if (!aot->program())
+				std::cerr << "ROM was not compiled ahead of time into this binary, using the interpreter\n";
+		}
+	}
+	else if (settings.useJit || settings.useAot)
+		std::cerr << "--jit and --aot run the default profile only, using the interpreter\n";
+
+	unsigned long long executed = 0;
+	unsigned long long frameCount = 0;
+	VChip8Pacer pacer(std::chrono::nanoseconds(1000000000 / 60));
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	//every frame runs its instructions as one batch and ticks the timers once; the run is counted in
+	//frames, a machine halted on Fx0A executes nothing until a key is down but its frames still pass
+	unsigned long long frames = (settings.instructions + settings.instructionsPerFrame - 1) / settings.instructionsPerFrame;
+	unsigned long long haltedFrames = 0;
+	while (frameCount < frames && chip8.get_error_code() == VChip8::ALL_OKAY){
+		unsigned long long remaining = settings.instructions - frameCount * settings.instructionsPerFrame;
+		unsigned int batch = remaining > settings.instructionsPerFrame ? settings.instructionsPerFrame : (unsigned int)remaining;
+		if (movie)
+			movie->apply(frameCount, chip8.keypad);
+		if (jit)
+			executed += jit->run_frame(batch);
+		else if (aot)
+			executed += aot->run_frame(batch);
+		else
+			executed += chip8.run_frame(batch);
+		if (chip8.halted)
+			++haltedFrames;
+		if (settings.hashesFilename)
+			hashes << std::dec << frameCount << std::hex << " " << std::setw(16) << chip8.get_state_hash()
+			       << " " << std::setw(16) << chip8.get_frame_hash() << "\n";
+		if (settings.wavFilename){
+			audioRing.push(VChip8AudioFrame::capture(chip8));
+			wav.write(samples.data(), synth.render_frame(samples.data()));
+		}
+		if (settings.captureFilename)
+			capture.submit(chip8, frameCount);
+		++frameCount;
+		if (settings.realtime)
+			pacer.wait();
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+	if (settings.wavFilename && !wav.close())
+		std::cerr << "Couldn't write " << settings.wavFilename << "\n";
+	if (settings.captureFilename && !capture.close())
+		std::cerr << "Couldn't write " << settings.captureFilename << "\n";
+
+	//00FD ends a SUPER-CHIP program normally
+	bool exited = chip8.get_error_code() == VChip8::PROGRAM_EXITED;
+	if (chip8.get_error_code() != VChip8::ALL_OKAY && !exited){
+		std::cerr << "An error occurred: " << chip8.get_error_code() << "\n"
+		          << chip8.get_error_name() << "\n";
+	}
+
+	if (settings.profilePrefix){
+#ifdef VCHIP8_PROFILE
+		std::ofstream json(std::string(settings.profilePrefix) + ".json");
+		chip8.write_profile_json(json);
+		std::ofstream folded(std::string(settings.profilePrefix) + ".folded");
+		folded << std::dec;
+		chip8.write_profile_collapsed(folded, settings.romFilename);
+#else
+		std::cerr << "--profile ignored, the core was built without VCHIP8_PROFILE\n";
+#endif
+	}
+
+	//a capture written to standard output keeps it to itself
+	std::ostream& report = settings.captureFilename && std::strcmp(settings.captureFilename, "-") == 0 ? std::cerr : std::cout;
+	report << "instructions:      " << executed << "\n"
+	       << "frames:            " << frameCount << "\n"
+	       << "halted frames:     " << haltedFrames << "\n"
+	       << "seconds:           " << std::fixed << std::setprecision(6) << seconds << "\n"
+	       << "instructions/sec:  " << std::setprecision(0) << (seconds > 0 ? executed / seconds : 0.0) << "\n"
+	       << "frames/sec:        " << (seconds > 0 ? frameCount / seconds : 0.0) << "\n"
+	       << "framebuffer hash:  0x" << std::hex << std::setw(16) << std::setfill('0') << chip8.get_frame_hash() << "\n";
+	if (settings.captureFilename){
+		report << std::dec
+		       << "captured frames:   " << capture.written() << " (" << capture.output_width() << "x" << capture.output_height() << ")\n"
+		       << "duplicate frames:  " << capture.duplicates() << "\n"
+		       << "dropped frames:    " << capture.dropped() << "\n";
+	}
+	if (settings.realtime){
+		VChip8Pacer::Stats timing = pacer.stats();
+		report << std::dec << std::setprecision(1)
+		       << "skipped frames:    " << timing.skipped << "\n"
+		       << "lateness mean:     " << timing.mean_lateness_us << " us\n"
+		       << "lateness jitter:   " << timing.jitter_us << " us\n"
+		       << "lateness max:      " << timing.max_lateness_us << " us\n";
+	}
+
+	return chip8.get_error_code() == VChip8::ALL_OKAY || exited ? 0 : -1;
+}
+
+//instantiates run_single for the quirk profile named on the command line
+template<class Bounds>
+static int run_profile(const char* quirks, const Settings& settings, VChip8Movie* movie){
+	if (std::strcmp(quirks, "vip") == 0)
+		return run_single<VChip8Core<VChip8QuirksVip, Bounds>>(settings, movie);
+	if (std::strcmp(quirks, "schip") == 0)
+		return run_single<VChip8Core<VChip8QuirksSchip, Bounds>>(settings, movie);
+	if (std::strcmp(quirks, "octo") == 0)
+		return run_single<VChip8Core<VChip8QuirksOcto, Bounds>>(settings, movie);
+	return run_single<VChip8Core<VChip8Quirks, Bounds>>(settings, movie);
+}
+
+int main(int argc, char** argv){
+
+	if (argc < 2)
+		usage(argv[0]);
+
+	Settings settings;
+	settings.romFilename = argv[1];
+	unsigned long long frames = 0;
+	unsigned int instances = 0;
+	unsigned int threads = 0;
+	bool lockstep = false;
+	char const* quirks = "default";
+	bool checked = false;
+	char const* movieFilename = nullptr;
+
+	for (int i = 2; i < argc; i++){
+		if (std::strcmp(argv[i], "--jit") == 0){
+			settings.useJit = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--aot") == 0){
+			settings.useAot = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--realtime") == 0){
+			settings.realtime = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--lockstep") == 0){
+			lockstep = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--checked") == 0){
+			checked = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--no-idle-skip") == 0){
+			settings.skipIdleLoops = false;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--debug") == 0){
+			settings.debug = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--capture-all") == 0){
+			settings.captureOptions.dedupe = false;
+			continue;
+		}
+		if (i + 1 >= argc)
+			usage(argv[0]);
+		if (std::strcmp(argv[i], "--instructions") == 0)
+			settings.instructions = std::stoull(argv[++i]);
+		else if (std::strcmp(argv[i], "--frames") == 0)
+			frames = std::stoull(argv[++i]);
+		else if (std::strcmp(argv[i], "--ipf") == 0)
+			settings.instructionsPerFrame = std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "--instances") == 0)
+			instances = std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "--threads") == 0)
+			threads = std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "--mode") == 0){
+			if (!VChip8::parse_mode(argv[++i], settings.mode))
+				usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--quirks") == 0){
+			quirks = argv[++i];
+			if (std::strcmp(quirks, "default") != 0 && std::strcmp(quirks, "vip") != 0 &&
+			    std::strcmp(quirks, "schip") != 0 && std::strcmp(quirks, "octo") != 0)
+				usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0)
+			settings.seed = std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "--replay") == 0)
+			movieFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--hashes") == 0)
+			settings.hashesFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--wav") == 0)
+			settings.wavFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--capture") == 0)
+			settings.captureFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--capture-format") == 0){
+			if (!VChip8Capture::parse_format(argv[++i], settings.captureOptions.format))
+				usage(argv[0]);
+			settings.captureFormatGiven = true;
+		}
+		else if (std::strcmp(argv[i], "--scale") == 0){
+			if (!VChip8Capture::parse_scaler(argv[++i], settings.captureOptions.scaler, settings.captureOptions.factor))
+				usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--profile") == 0)
+			settings.profilePrefix = argv[++i];
+		else if (std::strcmp(argv[i], "--debug-port") == 0){
+			settings.debug = true;
+			settings.debugPort = std::stoul(argv[++i]);
+			if (settings.debugPort == 0 || settings.debugPort > 0xFFFF)
+				usage(argv[0]);
+		}
+		else
+			usage(argv[0]);
+	}
+
+	//a replay runs with the recorded seed and frame size
+	VChip8Movie movie;
+	if (movieFilename){
+		if (!movie.load(movieFilename)){
+			std::cerr << "Couldn't read the movie " << movieFilename << "\n";
+			return -1;
+		}
+		settings.seed = movie.seed;
+		if (movie.mode >= VChip8::MODE_COUNT){
+			std::cerr << "Unknown mode in the movie " << movieFilename << "\n";
+			return -1;
+		}
+		settings.mode = (VChip8::Mode)movie.mode;
+		settings.instructionsPerFrame = movie.instructions_per_frame;
+		if (frames == 0)
+			frames = movie.frames();
+	}
+
+	if (frames > 0 || movieFilename)
+		settings.instructions = frames * settings.instructionsPerFrame;
+	if (settings.instructionsPerFrame == 0 || (settings.useJit && settings.useAot))
+		usage(argv[0]);
+
+	if (instances > 0 && settings.wavFilename)
+		std::cerr << "--wav is ignored with --instances\n";
+	if (instances > 0 && settings.captureFilename)
+		std::cerr << "--capture is ignored with --instances\n";
+	if (instances > 0 && (checked || std::strcmp(quirks, "default") != 0))
+		std::cerr << "--quirks and --checked are ignored with --instances\n";
+	if (instances > 0 && settings.debug)
+		std::cerr << "--debug is ignored with --instances\n";
+	if (instances > 0)
+		return run_instances(settings.romFilename, instances, threads, settings.mode, settings.seed,
+		                     (settings.instructions + settings.instructionsPerFrame - 1) / settings.instructionsPerFrame,
+		                     settings.instructionsPerFrame, settings.useJit || settings.useAot, lockstep,
+		                     movieFilename ? &movie : nullptr);
+
+	VChip8Movie* replay = movieFilename ? &movie : nullptr;
+	if (checked)
+		return run_profile<VChip8BoundsChecked>(quirks, settings, replay);
+	return run_profile<VChip8BoundsMasked>(quirks, settings, replay);
+}
@@ -0,0 +1,534 @@
+#include "../include/jit.hpp"
+#include <cstring>
+#include <initializer_list>
+
+//profiling builds keep every instruction in the counted interpreter
+#if defined(__x86_64__) && defined(__unix__) && !defined(VCHIP8_PROFILE)
+#define VCHIP8_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef VCHIP8_JIT_X86_64
+
+namespace {
+
+    //host register numbers
+    enum HostReg{
+        RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    //host registers the Vx registers are allocated from, rdi/rsi hold the arguments,
+    //rdx holds the index register and rax/rcx are scratch
+    const uint8_t register_pool[] = { R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15 };
+
+    //condition codes for setcc/cmovcc
+    const uint8_t CC_B = 0x2;
+    const uint8_t CC_E = 0x4;
+    const uint8_t CC_NE = 0x5;
+    const uint8_t CC_A = 0x7;
+
+    const uint16_t FONT_MEM = 0x050; //see VChip8::FONT_MEM
+
+    //minimal x86-64 encoder, byte registers always get a REX prefix so that 4-7 mean spl..dil
+    struct Emitter{
+        std::vector<uint8_t> bytes;
+
+        void byte(uint8_t value){
+            bytes.push_back(value);
+        }
+
+        void imm32(uint32_t value){
+            for (int i = 0; i < 4; i++)
+                byte((value >> (8 * i)) & 0xFFu);
+        }
+
+        void rex(uint8_t reg, uint8_t rm){
+            byte(0x40 | ((reg >> 3) << 2) | (rm >> 3));
+        }
+
+        void modrm(uint8_t mod, uint8_t reg, uint8_t rm){
+            byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        //op r/m8, r8 (mov 0x88, add 0x00, or 0x08, and 0x20, sub 0x28, xor 0x30, cmp 0x38)
+        void alu8(uint8_t opcode, uint8_t dst, uint8_t src){
+            rex(src, dst);
+            byte(opcode);
+            modrm(3, src, dst);
+        }
+
+        //op r/m8, imm8 (0x80 group: add /0, and /4, sub /5, cmp /7)
+        void alu8_imm(uint8_t ext, uint8_t dst, uint8_t value){
+            rex(0, dst);
+            byte(0x80);
+            modrm(3, ext, dst);
+            byte(value);
+        }
+
+        void mov8_imm(uint8_t dst, uint8_t value){
+            rex(0, dst);
+            byte(0xB0 + (dst & 7));
+            byte(value);
+        }
+
+        //shift r/m8 by one (shl /4, shr /5)
+        void shift8_1(uint8_t ext, uint8_t dst){
+            rex(0, dst);
+            byte(0xD0);
+            modrm(3, ext, dst);
+        }
+
+        void shift8_imm(uint8_t ext, uint8_t dst, uint8_t count){
+            rex(0, dst);
+            byte(0xC0);
+            modrm(3, ext, dst);
+            byte(count);
+        }
+
+        void setcc(uint8_t cc, uint8_t dst){
+            rex(0, dst);
+            byte(0x0F);
+            byte(0x90 | cc);
+            modrm(3, 0, dst);
+        }
+
+        void movzx32_8(uint8_t dst, uint8_t src){
+            rex(dst, src);
+            byte(0x0F);
+            byte(0xB6);
+            modrm(3, dst, src);
+        }
+
+        //movzx r32, byte [rdi + offset]
+        void load_register(uint8_t dst, uint8_t offset){
+            rex(dst, RDI);
+            byte(0x0F);
+            byte(0xB6);
+            modrm(1, dst, RDI);
+            byte(offset);
+        }
+
+        //mov byte [rdi + offset], r8
+        void store_register(uint8_t offset, uint8_t src){
+            rex(src, RDI);
+            byte(0x88);
+            modrm(1, src, RDI);
+            byte(offset);
+        }
+
+        void mov32_imm(uint8_t dst, uint32_t value){
+            byte(0xB8 + dst);
+            imm32(value);
+        }
+
+        void cmov(uint8_t cc, uint8_t dst, uint8_t src){
+            byte(0x0F);
+            byte(0x40 | cc);
+            modrm(3, dst, src);
+        }
+
+        void push(uint8_t reg){
+            if (reg >= R8)
+                byte(0x41);
+            byte(0x50 + (reg & 7));
+        }
+
+        void pop(uint8_t reg){
+            if (reg >= R8)
+                byte(0x41);
+            byte(0x58 + (reg & 7));
+        }
+    };
+
+    bool callee_saved(uint8_t reg){
+        return reg == RBX || reg == RBP || reg >= R12;
+    }
+
+    //changes the protection of the whole pages covering size bytes at code
+    bool protect(uint8_t* code, size_t size, int protection){
+        static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t first = (uintptr_t)code & ~(page - 1);
+        uintptr_t last = ((uintptr_t)code + size + page - 1) & ~(page - 1);
+        return mprotect(reinterpret_cast<void*>(first), last - first, protection) == 0;
+    }
+
+}
+
+VChip8Jit::VChip8Jit(VChip8& chip8) : chip8(chip8), code_buffer(nullptr), code_size(0), blocks(0x1000){
+    //the buffer is never writable and executable at once (W^X), pages are switched to read/execute
+    //after a block is written to them; hosts that refuse executable pages fall back to the interpreter
+    void* memory = mmap(nullptr, CODE_CAPACITY, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED){
+        this->code_buffer = static_cast<uint8_t*>(memory);
+        if (!protect(this->code_buffer, CODE_CAPACITY, PROT_READ | PROT_EXEC) ||
+            !protect(this->code_buffer, CODE_CAPACITY, PROT_READ | PROT_WRITE)){
+            munmap(this->code_buffer, CODE_CAPACITY);
+            this->code_buffer = nullptr;
+        }
+    }
+    flush();
+}
+
+VChip8Jit::~VChip8Jit(){
+    if (this->code_buffer)
+        munmap(this->code_buffer, CODE_CAPACITY);
+}
+
+void VChip8Jit::translate(uint16_t address, Block& block){
+    int host[16]; //host register of each Vx, -1 if unused
+    bool written[16] = {};
+    unsigned int allocated = 0;
+    bool index_used = false;
+    bool index_written = false;
+    for (int i = 0; i < 16; i++)
+        host[i] = -1;
+
+    //assigns host registers to the given Vx registers, false if the pool ran out
+    auto allocate = [&](std::initializer_list<uint8_t> needed) -> bool{
+        bool counted[16] = {};
+        unsigned int missing = 0;
+        for (uint8_t v : needed){
+            missing += (host[v] < 0 && !counted[v]);
+            counted[v] = true;
+        }
+        if (allocated + missing > sizeof(register_pool))
+            return false;
+        for (uint8_t v : needed){
+            if (host[v] < 0)
+                host[v] = register_pool[allocated++];
+        }
+        return true;
+    };
+
+    Emitter body;
+    unsigned int length = 0;
+    uint16_t pc = address;
+    bool ended = false; //the last instruction already computed the next pc in eax
+
+    while (!ended && length < MAX_BLOCK_LENGTH && pc + 1u < 0x1000u){
+        VChip8::Instruction instr = this->chip8.decode((this->chip8.memory[pc] << 8u) | this->chip8.memory[pc + 1]);
+        uint8_t x = instr.x;
+        uint8_t y = instr.y;
+        bool ok = true;
+
+        switch (instr.id)
+        {
+        case VChip8::ID_6xkk: case VChip8::ID_7xkk: case VChip8::ID_3xkk: case VChip8::ID_4xkk:
+        case VChip8::ID_Fx1E: case VChip8::ID_Fx29:
+            ok = allocate({x});
+            break;
+        case VChip8::ID_8xy0: case VChip8::ID_8xy1: case VChip8::ID_8xy2: case VChip8::ID_8xy3:
+        case VChip8::ID_5xy0: case VChip8::ID_9xy0:
+            ok = allocate({x, y});
+            break;
+        case VChip8::ID_8xy4: case VChip8::ID_8xy5: case VChip8::ID_8xy6: case VChip8::ID_8xy7:
+        case VChip8::ID_8xyE:
+            ok = allocate({x, y, 0xF});
+            break;
+        case VChip8::ID_Bnnn:
+            ok = allocate({0});
+            break;
+        case VChip8::ID_1nnn: case VChip8::ID_Annn:
+            break;
+        default:
+            //left to the interpreter
+            ok = false;
+            break;
+        }
+        if (!ok)
+            break;
+
+        uint8_t X = host[x] >= 0 ? host[x] : 0;
+        uint8_t Y = host[y] >= 0 ? host[y] : 0;
+        uint8_t F = host[0xF] >= 0 ? host[0xF] : 0;
+        uint16_t next = pc + 2;
+
+        //each case follows the statement order of the matching VChip8::OP_* handler,
+        //so aliasing between x, y and VF behaves the same
+        switch (instr.id)
+        {
+        case VChip8::ID_1nnn:
+            body.mov32_imm(RAX, instr.nnn);
+            ended = true;
+            break;
+        case VChip8::ID_Bnnn:
+            body.movzx32_8(RAX, host[0]);
+            body.byte(0x05); //add eax, imm32
+            body.imm32(instr.nnn);
+            ended = true;
+            break;
+        case VChip8::ID_3xkk:
+        case VChip8::ID_4xkk:
+            body.alu8_imm(7, X, instr.kk);
+            body.mov32_imm(RAX, next);
+            body.mov32_imm(RCX, next + 2);
+            body.cmov(instr.id == VChip8::ID_3xkk ? CC_E : CC_NE, RAX, RCX);
+            ended = true;
+            break;
+        case VChip8::ID_5xy0:
+        case VChip8::ID_9xy0:
+            body.alu8(0x38, X, Y);
+            body.mov32_imm(RAX, next);
+            body.mov32_imm(RCX, next + 2);
+            body.cmov(instr.id == VChip8::ID_5xy0 ? CC_E : CC_NE, RAX, RCX);
+            ended = true;
+            break;
+        case VChip8::ID_6xkk:
+            body.mov8_imm(X, instr.kk);
+            written[x] = true;
+            break;
+        case VChip8::ID_7xkk:
+            body.alu8_imm(0, X, instr.kk);
+            written[x] = true;
+            break;
+        case VChip8::ID_8xy0:
+            body.alu8(0x88, X, Y);
+            written[x] = true;
+            break;
+        case VChip8::ID_8xy1:
+            body.alu8(0x08, X, Y);
+            written[x] = true;
+            break;
+        case VChip8::ID_8xy2:
+            body.alu8(0x20, X, Y);
+            written[x] = true;
+            break;
+        case VChip8::ID_8xy3:
+            body.alu8(0x30, X, Y);
+            written[x] = true;
+            break;
+        case VChip8::ID_8xy4:
+            body.alu8(0x88, RAX, X);
+            body.alu8(0x00, RAX, Y);
+            body.setcc(CC_B, RCX);
+            body.alu8(0x88, F, RCX);
+            body.alu8(0x88, X, RAX);
+            written[x] = written[0xF] = true;
+            break;
+        case VChip8::ID_8xy5:
+            body.alu8(0x38, X, Y);
+            body.setcc(CC_A, RCX);
+            body.alu8(0x88, F, RCX);
+            body.alu8(0x28, X, Y);
+            written[x] = written[0xF] = true;
+            break;
+        case VChip8::ID_8xy6:
+            body.alu8(0x88, RAX, X);
+            body.alu8_imm(4, RAX, 0x1);
+            body.alu8(0x88, F, RAX);
+            body.shift8_1(5, X);
+            written[x] = written[0xF] = true;
+            break;
+        case VChip8::ID_8xy7:
+            body.alu8(0x38, X, Y);
+            body.setcc(CC_A, RCX);
+            body.alu8(0x88, F, RCX);
+            body.alu8(0x88, RAX, Y);
+            body.alu8(0x28, RAX, X);
+            body.alu8(0x88, X, RAX);
+            written[x] = written[0xF] = true;
+            break;
+        case VChip8::ID_8xyE:
+            body.alu8(0x88, RAX, X);
+            body.shift8_imm(5, RAX, 7);
+            body.alu8(0x88, F, RAX);
+            body.shift8_1(4, X);
+            written[x] = written[0xF] = true;
+            break;
+        case VChip8::ID_Annn:
+            body.mov32_imm(RDX, instr.nnn);
+            index_used = index_written = true;
+            break;
+        case VChip8::ID_Fx1E:
+            body.movzx32_8(RAX, X);
+            body.byte(0x66); //add dx, ax
+            body.byte(0x01);
+            body.modrm(3, RAX, RDX);
+            index_used = index_written = true;
+            break;
+        case VChip8::ID_Fx29:
+            body.movzx32_8(RAX, X);
+            body.byte(0x8D); //lea edx, [rax + rax * 4 + FONT_MEM]
+            body.byte(0x94);
+            body.byte(0x80);
+            body.imm32(FONT_MEM);
+            index_used = index_written = true;
+            break;
+        }
+
+        ++length;
+        pc = next;
+    }
+
+    if (!ended)
+        body.mov32_imm(RAX, pc);
+
+    //nothing translatable at address, count the run of instructions the interpreter can take
+    //in one call, up to the first one that may branch or write to memory
+    unsigned int interpreted = 0;
+    for (uint16_t i = address; !length && interpreted < MAX_BLOCK_LENGTH && i + 1u < 0x1000u; i += 2){
+        VChip8::Instruction instr = this->chip8.decode((this->chip8.memory[i] << 8u) | this->chip8.memory[i + 1]);
+        bool stop = false;
+        switch (instr.id)
+        {
+        case VChip8::ID_00E0: case VChip8::ID_Cxkk: case VChip8::ID_Dxyn: case VChip8::ID_Fx07:
+        case VChip8::ID_Fx15: case VChip8::ID_Fx18: case VChip8::ID_Fx65:
+            break;
+        case VChip8::ID_00EE: case VChip8::ID_2nnn: case VChip8::ID_Ex9E: case VChip8::ID_ExA1:
+        case VChip8::ID_Fx0A: case VChip8::ID_Fx33: case VChip8::ID_Fx55: case VChip8::ID_NULL:
+            stop = true;
+            break;
+        default:
+            //translatable, the next block starts here
+            stop = (interpreted > 0);
+            if (stop)
+                --interpreted;
+            break;
+        }
+        ++interpreted;
+        if (stop)
+            break;
+    }
+
+    block.translated = true;
+    block.length = length;
+    block.interpreted = interpreted;
+    block.code = nullptr;
+    block.first_page = address / 256;
+    block.last_page = length ? (pc - 1) / 256 : block.first_page;
+    block.first_generation = this->chip8.page_generation[block.first_page];
+    block.last_generation = this->chip8.page_generation[block.last_page];
+    if (!length)
+        return;
+
+    Emitter code;
+    for (unsigned int i = 0; i < allocated; i++){
+        if (callee_saved(register_pool[i]))
+            code.push(register_pool[i]);
+    }
+    for (int v = 0; v < 16; v++){
+        if (host[v] >= 0)
+            code.load_register(host[v], v);
+    }
+    if (index_used){
+        code.byte(0x0F); //movzx edx, word [rsi]
+        code.byte(0xB7);
+        code.modrm(0, RDX, RSI);
+    }
+
+    code.bytes.insert(code.bytes.end(), body.bytes.begin(), body.bytes.end());
+
+    for (int v = 0; v < 16; v++){
+        if (written[v])
+            code.store_register(v, host[v]);
+    }
+    if (index_written){
+        code.byte(0x66); //mov word [rsi], dx
+        code.byte(0x89);
+        code.modrm(0, RDX, RSI);
+    }
+    for (unsigned int i = allocated; i-- > 0;){
+        if (callee_saved(register_pool[i]))
+            code.pop(register_pool[i]);
+    }
+    code.byte(0xC3); //ret
+
+    if (this->code_size + code.bytes.size() > CODE_CAPACITY){
+        //out of space, start over, the current block is translated again below
+        flush();
+        block.translated = true;
+    }
+    //the first page may already hold blocks, they are not run until it is executable again
+    uint8_t* target = this->code_buffer + this->code_size;
+    if (!protect(target, code.bytes.size(), PROT_READ | PROT_WRITE)){
+        block.length = 0;
+        block.interpreted = 1;
+        return;
+    }
+    memcpy(target, code.bytes.data(), code.bytes.size());
+    if (!protect(target, code.bytes.size(), PROT_READ | PROT_EXEC)){
+        block.length = 0;
+        block.interpreted = 1;
+        return;
+    }
+    block.code = reinterpret_cast<BlockFunc>(target);
+    this->code_size += code.bytes.size();
+}
+
+bool VChip8Jit::available() const{
+    return this->code_buffer != nullptr;
+}
+
+#else
+
+VChip8Jit::VChip8Jit(VChip8& chip8) : chip8(chip8), code_buffer(nullptr), code_size(0){
+}
+
+VChip8Jit::~VChip8Jit(){
+}
+
+void VChip8Jit::translate(uint16_t, Block& block){
+    block.translated = true;
+    block.length = 0;
+    block.interpreted = 1;
+}
+
+bool VChip8Jit::available() const{
+    return false;
+}
+
+#endif
+
+void VChip8Jit::flush(){
+    for (size_t i = 0; i < this->blocks.size(); i++){
+        this->blocks[i].translated = false;
+    }
+    this->code_size = 0;
+}
+
+unsigned int VChip8Jit::run(unsigned int instructions){
+    //only CHIP-8 code is translated
+    if (!available() || this->chip8.get_mode() != VChip8::MODE_CHIP8)
+        return this->chip8.run(instructions);
+
+    //halted on Fx0A, see VChip8::halted
+    if (!this->chip8.wake())
+        return 0;
+    unsigned int executed = 0;
+    while (executed < instructions && this->chip8.get_error_code() == VChip8::ALL_OKAY && !this->chip8.halted){
+        uint16_t pc = this->chip8.program_counter;
+        if (pc + 1u >= 0x1000u){
+            executed += this->chip8.run(1);
+            continue;
+        }
+
+        Block& block = this->blocks[pc];
+        if (!block.translated ||
+            block.first_generation != this->chip8.page_generation[block.first_page] ||
+            block.last_generation != this->chip8.page_generation[block.last_page]){
+            translate(pc, block);
+        }
+
+        if (!block.length){
+            unsigned int count = block.interpreted;
+            executed += this->chip8.run(count < instructions - executed ? count : instructions - executed);
+            continue;
+        }
+        if (block.length > instructions - executed){
+            executed += this->chip8.run(1);
+            continue;
+        }
+
+        this->chip8.program_counter = block.code(this->chip8.registers, &this->chip8.index_register);
+        executed += block.length;
+    }
+    return executed;
+}
+
+unsigned int VChip8Jit::run_frame(unsigned int instructions){
+    unsigned int executed = run(instructions);
+    this->chip8.tick_timers();
+    return executed;
+}
@@ -0,0 +1,479 @@
+#include "../include/lockstep.hpp"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+    //byte vectors over consecutive lanes, operations work on unsigned bytes
+#if defined(__AVX2__)
+    typedef __m256i Vec;
+    const unsigned int VEC_BYTES = 32;
+
+    inline Vec load(const uint8_t* p){ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void store(uint8_t* p, Vec v){ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline Vec splat(uint8_t b){ return _mm256_set1_epi8((char)b); }
+    inline Vec add(Vec a, Vec b){ return _mm256_add_epi8(a, b); }
+    inline Vec sub(Vec a, Vec b){ return _mm256_sub_epi8(a, b); }
+    inline Vec and_(Vec a, Vec b){ return _mm256_and_si256(a, b); }
+    inline Vec or_(Vec a, Vec b){ return _mm256_or_si256(a, b); }
+    inline Vec xor_(Vec a, Vec b){ return _mm256_xor_si256(a, b); }
+    inline Vec eq(Vec a, Vec b){ return _mm256_cmpeq_epi8(a, b); }
+    inline Vec min_(Vec a, Vec b){ return _mm256_min_epu8(a, b); }
+    inline Vec select(Vec mask, Vec a, Vec b){ return _mm256_blendv_epi8(b, a, mask); }
+    inline Vec shr(Vec a, int n){ return and_(_mm256_srli_epi16(a, n), splat(0xFFu >> n)); }
+    inline Vec subs(Vec a, Vec b){ return _mm256_subs_epu8(a, b); }
+#elif defined(__SSE2__)
+    typedef __m128i Vec;
+    const unsigned int VEC_BYTES = 16;
+
+    inline Vec load(const uint8_t* p){ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void store(uint8_t* p, Vec v){ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline Vec splat(uint8_t b){ return _mm_set1_epi8((char)b); }
+    inline Vec add(Vec a, Vec b){ return _mm_add_epi8(a, b); }
+    inline Vec sub(Vec a, Vec b){ return _mm_sub_epi8(a, b); }
+    inline Vec and_(Vec a, Vec b){ return _mm_and_si128(a, b); }
+    inline Vec or_(Vec a, Vec b){ return _mm_or_si128(a, b); }
+    inline Vec xor_(Vec a, Vec b){ return _mm_xor_si128(a, b); }
+    inline Vec eq(Vec a, Vec b){ return _mm_cmpeq_epi8(a, b); }
+    inline Vec min_(Vec a, Vec b){ return _mm_min_epu8(a, b); }
+    inline Vec select(Vec mask, Vec a, Vec b){ return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+    inline Vec shr(Vec a, int n){ return and_(_mm_srli_epi16(a, n), splat(0xFFu >> n)); }
+    inline Vec subs(Vec a, Vec b){ return _mm_subs_epu8(a, b); }
+#else
+    struct Vec{ uint8_t b[8]; };
+    const unsigned int VEC_BYTES = 8;
+
+    inline Vec load(const uint8_t* p){ Vec v; std::memcpy(v.b, p, VEC_BYTES); return v; }
+    inline void store(uint8_t* p, Vec v){ std::memcpy(p, v.b, VEC_BYTES); }
+    inline Vec splat(uint8_t b){ Vec v; std::memset(v.b, b, VEC_BYTES); return v; }
+#define VCHIP8_LANEWISE(name, expr) \
+    inline Vec name(Vec a, Vec b){ Vec r; for (unsigned int i = 0; i < VEC_BYTES; i++) r.b[i] = (uint8_t)(expr); return r; }
+    VCHIP8_LANEWISE(add, a.b[i] + b.b[i])
+    VCHIP8_LANEWISE(sub, a.b[i] - b.b[i])
+    VCHIP8_LANEWISE(and_, a.b[i] & b.b[i])
+    VCHIP8_LANEWISE(or_, a.b[i] | b.b[i])
+    VCHIP8_LANEWISE(xor_, a.b[i] ^ b.b[i])
+    VCHIP8_LANEWISE(eq, a.b[i] == b.b[i] ? 0xFF : 0)
+    VCHIP8_LANEWISE(min_, a.b[i] < b.b[i] ? a.b[i] : b.b[i])
+    VCHIP8_LANEWISE(subs, a.b[i] > b.b[i] ? a.b[i] - b.b[i] : 0)
+#undef VCHIP8_LANEWISE
+    inline Vec select(Vec mask, Vec a, Vec b){ return or_(and_(mask, a), and_(xor_(mask, splat(0xFF)), b)); }
+    inline Vec shr(Vec a, int n){ Vec r; for (unsigned int i = 0; i < VEC_BYTES; i++) r.b[i] = a.b[i] >> n; return r; }
+#endif
+
+    //unsigned a > b, as a lane mask
+    inline Vec gt(Vec a, Vec b){ return xor_(eq(min_(a, b), a), splat(0xFF)); }
+
+    //lane mask to 0/1
+    inline Vec flag(Vec mask){ return and_(mask, splat(1)); }
+
+    const uint16_t FONT_MEM = 0x050; //see VChip8::FONT_MEM
+
+    //instructions that keep a block going, same set as VChip8::decode_block
+    bool straight_line(uint8_t id){
+        switch (id)
+        {
+        case VChip8::ID_00E0: case VChip8::ID_6xkk: case VChip8::ID_7xkk: case VChip8::ID_8xy0: case VChip8::ID_8xy1:
+        case VChip8::ID_8xy2: case VChip8::ID_8xy3: case VChip8::ID_8xy4: case VChip8::ID_8xy5: case VChip8::ID_8xy6:
+        case VChip8::ID_8xy7: case VChip8::ID_8xyE: case VChip8::ID_Annn: case VChip8::ID_Cxkk: case VChip8::ID_Dxyn:
+        case VChip8::ID_Fx07: case VChip8::ID_Fx15: case VChip8::ID_Fx18: case VChip8::ID_Fx1E: case VChip8::ID_Fx29:
+        case VChip8::ID_Fx65:
+            return true;
+        }
+        return false;
+    }
+
+    //instructions execute_vector handles for a whole group
+    bool vectorized(uint8_t id){
+        switch (id)
+        {
+        case VChip8::ID_1nnn: case VChip8::ID_3xkk: case VChip8::ID_4xkk: case VChip8::ID_5xy0: case VChip8::ID_6xkk:
+        case VChip8::ID_7xkk: case VChip8::ID_8xy0: case VChip8::ID_8xy1: case VChip8::ID_8xy2: case VChip8::ID_8xy3:
+        case VChip8::ID_8xy4: case VChip8::ID_8xy5: case VChip8::ID_8xy6: case VChip8::ID_8xy7: case VChip8::ID_8xyE:
+        case VChip8::ID_9xy0: case VChip8::ID_Annn: case VChip8::ID_Bnnn: case VChip8::ID_Fx07: case VChip8::ID_Fx15:
+        case VChip8::ID_Fx18: case VChip8::ID_Fx1E: case VChip8::ID_Fx29:
+            return true;
+        }
+        return false;
+    }
+
+    //Vx registers a handler run by execute_lane reads or writes, one bit per register,
+    //only these are moved between the arrays and the lane's VChip8
+    uint16_t lane_registers(const VChip8::Instruction& instr){
+        switch (instr.id)
+        {
+        case VChip8::ID_NULL: case VChip8::ID_00E0: case VChip8::ID_00EE: case VChip8::ID_2nnn:
+            return 0;
+        case VChip8::ID_Cxkk: case VChip8::ID_Ex9E: case VChip8::ID_ExA1: case VChip8::ID_Fx0A: case VChip8::ID_Fx33:
+            return 1u << instr.x;
+        case VChip8::ID_Dxyn:
+            return (1u << instr.x) | (1u << instr.y) | 0x8000u;
+        case VChip8::ID_Fx55: case VChip8::ID_Fx65:
+            return (2u << instr.x) - 1;
+        }
+        return 0xFFFFu;
+    }
+
+    uint16_t opcode_at(const VChip8& chip8, uint16_t address){
+        return (chip8.memory[address & 0xFFFu] << 8u) | chip8.memory[(address + 1u) & 0xFFFu];
+    }
+
+}
+
+VChip8Lockstep::VChip8Lockstep(unsigned int lanes){
+    this->lanes = lanes;
+    this->stride = (lanes + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN;
+
+    for (unsigned int l = 0; l < lanes; l++)
+        this->machines.push_back(std::unique_ptr<VChip8>(new VChip8()));
+
+    this->registers.assign(16 * this->stride, 0);
+    this->index_register.assign(this->stride, 0);
+    this->program_counter.assign(this->stride, 0);
+    this->delay_timer.assign(this->stride, 0);
+    this->sound_timer.assign(this->stride, 0);
+    this->active.assign(this->stride, 0);
+    this->executed.assign(this->stride, 0);
+    std::memset(this->baseline_generation, 0, sizeof(this->baseline_generation));
+
+    load_lanes();
+}
+
+void VChip8Lockstep::loadRom(const char* file_path){
+    if (this->lanes == 0)
+        return;
+
+    //the file is read once, the other lanes start as copies of the first
+    this->machines[0]->loadRom(file_path);
+    share_first_lane();
+}
+
+void VChip8Lockstep::loadRom(const uint8_t* rom, size_t size){
+    if (this->lanes == 0)
+        return;
+
+    this->machines[0]->loadRom(rom, size);
+    share_first_lane();
+}
+
+void VChip8Lockstep::share_first_lane(){
+    //every lane keeps its own RNG
+    for (unsigned int l = 1; l < this->lanes; l++){
+        std::default_random_engine randGen = this->machines[l]->randGen;
+        this->machines[l].reset(new VChip8(*this->machines[0]));
+        this->machines[l]->randGen = randGen;
+    }
+    std::memcpy(this->baseline_generation, this->machines[0]->page_generation, sizeof(this->baseline_generation));
+
+    load_lanes();
+}
+
+unsigned int VChip8Lockstep::size() const{
+    return this->lanes;
+}
+
+VChip8& VChip8Lockstep::machine(unsigned int lane){
+    return *this->machines[lane];
+}
+
+int VChip8Lockstep::get_error_code(unsigned int lane){
+    return this->machines[lane]->get_error_code();
+}
+
+void VChip8Lockstep::load_lanes(){
+    for (unsigned int l = 0; l < this->lanes; l++){
+        const VChip8& chip8 = *this->machines[l];
+        for (unsigned int r = 0; r < 16; r++)
+            row(r)[l] = chip8.registers[r];
+        this->index_register[l] = chip8.index_register;
+        this->program_counter[l] = chip8.program_counter;
+        this->delay_timer[l] = chip8.delay_timer;
+        this->sound_timer[l] = chip8.sound_timer;
+    }
+}
+
+void VChip8Lockstep::store_lanes(){
+    for (unsigned int l = 0; l < this->lanes; l++){
+        VChip8& chip8 = *this->machines[l];
+        for (unsigned int r = 0; r < 16; r++)
+            chip8.registers[r] = row(r)[l];
+        chip8.index_register = this->index_register[l];
+        chip8.program_counter = this->program_counter[l];
+        chip8.delay_timer = this->delay_timer[l];
+        chip8.sound_timer = this->sound_timer[l];
+    }
+}
+
+bool VChip8Lockstep::code_matches(unsigned int lane, unsigned int reference, uint16_t address, unsigned int bytes){
+    if (lane == reference)
+        return true;
+
+    //lanes start with the same ROM, code on pages neither lane rewrote is still identical
+    const VChip8& a = *this->machines[lane];
+    const VChip8& b = *this->machines[reference];
+    bool untouched = true;
+    //an instruction at 0xFFF reads its second byte from 0x000, the pages wrap along with the fetch
+    unsigned int first = (address & 0xFFFu) / 256;
+    unsigned int last = ((address & 0xFFFu) + bytes - 1u) / 256;
+    for (unsigned int page = first; page <= last && untouched; page++)
+        untouched = a.page_generation[page % 16] == this->baseline_generation[page % 16] &&
+                    b.page_generation[page % 16] == this->baseline_generation[page % 16];
+    if (untouched)
+        return true;
+
+    for (unsigned int i = 0; i < bytes; i++){
+        if (a.memory[(address + i) & 0xFFFu] != b.memory[(address + i) & 0xFFFu])
+            return false;
+    }
+    return true;
+}
+
+void VChip8Lockstep::execute_lane(unsigned int lane, const VChip8::Instruction& instr, uint16_t next){
+    //gather the lane into its VChip8, run the reference handler and scatter it back
+    VChip8& chip8 = *this->machines[lane];
+    uint16_t used = lane_registers(instr);
+    for (unsigned int r = 0; r < 16; r++)
+        if (used & (1u << r)) chip8.registers[r] = row(r)[lane];
+    chip8.index_register = this->index_register[lane];
+    chip8.program_counter = next;
+    chip8.delay_timer = this->delay_timer[lane];
+    chip8.sound_timer = this->sound_timer[lane];
+
+    (chip8.*(VChip8::handlers[instr.id]))(instr);
+
+    for (unsigned int r = 0; r < 16; r++)
+        if (used & (1u << r)) row(r)[lane] = chip8.registers[r];
+    this->index_register[lane] = chip8.index_register;
+    this->program_counter[lane] = chip8.program_counter;
+    this->delay_timer[lane] = chip8.delay_timer;
+    this->sound_timer[lane] = chip8.sound_timer;
+}
+
+void VChip8Lockstep::execute_vector(const VChip8::Instruction& instr, uint16_t next){
+    const uint8_t* mask = this->active.data();
+
+    //index register and program counter are 16-bit, plain loops over the group
+    switch (instr.id)
+    {
+    case VChip8::ID_1nnn:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = instr.nnn;
+        return;
+    case VChip8::ID_Bnnn:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = row(0)[l] + instr.nnn;
+        return;
+    case VChip8::ID_3xkk:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = next + (row(instr.x)[l] == instr.kk ? 2 : 0);
+        return;
+    case VChip8::ID_4xkk:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = next + (row(instr.x)[l] != instr.kk ? 2 : 0);
+        return;
+    case VChip8::ID_5xy0:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = next + (row(instr.x)[l] == row(instr.y)[l] ? 2 : 0);
+        return;
+    case VChip8::ID_9xy0:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->program_counter[l] = next + (row(instr.x)[l] != row(instr.y)[l] ? 2 : 0);
+        return;
+    case VChip8::ID_Annn:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->index_register[l] = instr.nnn;
+        return;
+    case VChip8::ID_Fx1E:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->index_register[l] += row(instr.x)[l];
+        return;
+    case VChip8::ID_Fx29:
+        for (unsigned int l = 0; l < this->lanes; l++)
+            if (mask[l]) this->index_register[l] = FONT_MEM + 5 * row(instr.x)[l];
+        return;
+    }
+
+    //byte operations, a vector of lanes at a time; every step reloads what an earlier store
+    //in the same instruction may have changed, so x or y being F behaves like the handlers
+    uint8_t* vx = row(instr.x);
+    uint8_t* vy = row(instr.y);
+    uint8_t* vf = row(0xF);
+    const Vec one = splat(1);
+    for (unsigned int c = 0; c < this->stride; c += VEC_BYTES){
+        Vec m = load(mask + c);
+        Vec x = load(vx + c);
+        Vec y = load(vy + c);
+        switch (instr.id)
+        {
+        case VChip8::ID_6xkk:
+            store(vx + c, select(m, splat(instr.kk), x));
+            break;
+        case VChip8::ID_7xkk:
+            store(vx + c, select(m, add(x, splat(instr.kk)), x));
+            break;
+        case VChip8::ID_8xy0:
+            store(vx + c, select(m, y, x));
+            break;
+        case VChip8::ID_8xy1:
+            store(vx + c, select(m, or_(x, y), x));
+            break;
+        case VChip8::ID_8xy2:
+            store(vx + c, select(m, and_(x, y), x));
+            break;
+        case VChip8::ID_8xy3:
+            store(vx + c, select(m, xor_(x, y), x));
+            break;
+        case VChip8::ID_8xy4:{
+            Vec sum = add(x, y);
+            store(vf + c, select(m, flag(gt(x, sum)), load(vf + c)));
+            x = load(vx + c);
+            store(vx + c, select(m, sum, x));
+        } break;
+        case VChip8::ID_8xy5:
+            store(vf + c, select(m, flag(gt(x, y)), load(vf + c)));
+            x = load(vx + c);
+            y = load(vy + c);
+            store(vx + c, select(m, sub(x, y), x));
+            break;
+        case VChip8::ID_8xy6:
+            store(vf + c, select(m, and_(x, one), load(vf + c)));
+            x = load(vx + c);
+            store(vx + c, select(m, shr(x, 1), x));
+            break;
+        case VChip8::ID_8xy7:
+            store(vf + c, select(m, flag(gt(x, y)), load(vf + c)));
+            x = load(vx + c);
+            y = load(vy + c);
+            store(vx + c, select(m, sub(y, x), x));
+            break;
+        case VChip8::ID_8xyE:
+            store(vf + c, select(m, shr(x, 7), load(vf + c)));
+            x = load(vx + c);
+            store(vx + c, select(m, add(x, x), x));
+            break;
+        case VChip8::ID_Fx07:
+            store(vx + c, select(m, load(&this->delay_timer[c]), x));
+            break;
+        case VChip8::ID_Fx15:
+            store(&this->delay_timer[c], select(m, x, load(&this->delay_timer[c])));
+            break;
+        case VChip8::ID_Fx18:
+            store(&this->sound_timer[c], select(m, x, load(&this->sound_timer[c])));
+            break;
+        }
+    }
+}
+
+uint64_t VChip8Lockstep::run(unsigned int instructions){
+    std::vector<uint32_t> limit(this->lanes);
+    for (unsigned int l = 0; l < this->lanes; l++){
+        this->executed[l] = 0;
+        //a lane halted on Fx0A sits the call out until a key is down
+        limit[l] = this->machines[l]->get_error_code() == VChip8::ALL_OKAY && this->machines[l]->wake() ? instructions : 0;
+    }
+
+    //the vector forms only cover CHIP-8, the lanes of a SUPER-CHIP or XO-CHIP ROM run on their own interpreters
+    if (this->lanes > 0 && this->machines[0]->get_mode() != VChip8::MODE_CHIP8){
+        store_lanes();
+        uint64_t total = 0;
+        for (unsigned int l = 0; l < this->lanes; l++){
+            this->executed[l] = this->machines[l]->run(limit[l]);
+            total += this->executed[l];
+        }
+        load_lanes();
+        return total;
+    }
+
+    VChip8::Instruction block[MAX_BLOCK_LENGTH];
+    for (;;){
+        //the group is every running lane on the lowest program counter
+        uint16_t start = 0xFFFFu;
+        unsigned int reference = this->lanes;
+        for (unsigned int l = 0; l < this->lanes; l++){
+            if (this->executed[l] < limit[l] && this->program_counter[l] < start){
+                start = this->program_counter[l];
+                reference = l;
+            }
+        }
+        if (reference == this->lanes)
+            break;
+
+        //decode the block from the reference lane, it ends like the blocks of VChip8::run
+        const VChip8& chip8 = *this->machines[reference];
+        unsigned int length = 0;
+        uint16_t pc = start;
+        do{
+            block[length++] = chip8.decode(opcode_at(chip8, pc));
+            pc += 2;
+        } while (length < MAX_BLOCK_LENGTH && straight_line(block[length - 1].id) && pc + 1u < 0x1000u);
+
+        //lanes on the same address whose code differs take a single step of their own
+        uint32_t budget = limit[reference] - this->executed[reference];
+        for (unsigned int l = 0; l < this->lanes; l++){
+            bool member = this->executed[l] < limit[l] && this->program_counter[l] == start;
+            if (member && !code_matches(l, reference, start, 2 * length)){
+                execute_lane(l, this->machines[l]->decode(opcode_at(*this->machines[l], start)), start + 2);
+                this->executed[l] += 1;
+                if (this->machines[l]->get_error_code() != VChip8::ALL_OKAY || this->machines[l]->halted)
+                    limit[l] = this->executed[l];
+                member = false;
+            }
+            this->active[l] = member ? 0xFFu : 0;
+            if (member && limit[l] - this->executed[l] < budget)
+                budget = limit[l] - this->executed[l];
+        }
+        if (length > budget)
+            length = budget;
+
+        bool fallback = false; //only the VChip8 handlers can raise errors
+        for (unsigned int i = 0; i < length; i++){
+            uint16_t next = start + 2 * (i + 1);
+            if (vectorized(block[i].id)){
+                execute_vector(block[i], next);
+            }
+            else{
+                fallback = true;
+                for (unsigned int l = 0; l < this->lanes; l++)
+                    if (this->active[l]) execute_lane(l, block[i], next);
+            }
+        }
+
+        //straight-line instructions leave the program counter to the block
+        bool fallthrough = straight_line(block[length - 1].id);
+        uint16_t end = start + 2 * length;
+        for (unsigned int l = 0; l < this->lanes; l++){
+            if (!this->active[l])
+                continue;
+            if (fallthrough)
+                this->program_counter[l] = end;
+            this->executed[l] += length;
+            //like VChip8::run, errors and a halting Fx0A stop a lane at the end of its block
+            if (fallback && (this->machines[l]->get_error_code() != VChip8::ALL_OKAY || this->machines[l]->halted))
+                limit[l] = this->executed[l];
+        }
+    }
+
+    uint64_t total = 0;
+    for (unsigned int l = 0; l < this->lanes; l++)
+        total += this->executed[l];
+    return total;
+}
+
+uint64_t VChip8Lockstep::run_frame(unsigned int instructions){
+    uint64_t total = run(instructions);
+    tick_timers();
+    return total;
+}
+
+void VChip8Lockstep::tick_timers(){
+    const Vec one = splat(1);
+    for (unsigned int c = 0; c < this->stride; c += VEC_BYTES){
+        store(&this->delay_timer[c], subs(load(&this->delay_timer[c]), one));
+        store(&this->sound_timer[c], subs(load(&this->sound_timer[c]), one));
+    }
+}
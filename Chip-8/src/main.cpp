@@ -1,51 +1,261 @@
 #include "../include/chip_8.hpp"
 #include "../include/platform.hpp"
+#include "../include/video.hpp"
+#include "../include/movie.hpp"
+#include "../include/exchange.hpp"
+#include "../include/pacer.hpp"
+#include "../include/capture.hpp"
+#include "../include/rewind.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 const unsigned int VIDEO_WIDTH = 64;
 const unsigned int VIDEO_HEIGHT = 32;
+const unsigned int MAX_VIDEO_WIDTH = 128;  //SUPER-CHIP/XO-CHIP hi-res
+const unsigned int MAX_VIDEO_HEIGHT = 64;
+
+//XO-CHIP colours for (plane 1, plane 0) = 00, 01, 10, 11
+const uint32_t PLANE_PALETTE[4] = { PIXEL_OFF, PIXEL_ON, 0xAAAAAAFFu, 0x555555FFu };
+
+const std::chrono::nanoseconds FRAME_PERIOD(1000000000 / 60); //one 60Hz frame
+const size_t REWIND_BUDGET = 32 << 20; //bytes of rewind history, minutes of a typical ROM
+
+//grows [top, bottom) by the rows the machine drew since the last call
+static void collect_dirty_rows(VChip8& chip8, unsigned int& top, unsigned int& bottom){
+	unsigned int drawnTop, drawnBottom;
+	if (!chip8.take_dirty_rows(drawnTop, drawnBottom))
+		return;
+	if (top >= bottom){
+		top = drawnTop;
+		bottom = drawnBottom;
+		return;
+	}
+	if (drawnTop < top)
+		top = drawnTop;
+	if (drawnBottom > bottom)
+		bottom = drawnBottom;
+}
+
+//hands the display to the presenter with the rows changed since the previously published frame
+static void publish_frame(const VChip8& chip8, uint64_t frameNumber, VChip8TripleBuffer& frames, uint64_t& published,
+                          unsigned int& dirtyTop, unsigned int& dirtyBottom){
+	VChip8Frame& frame = frames.back();
+	frame.capture(chip8, frameNumber);
+	frame.previous = published;
+	frame.dirty_top = (uint8_t)dirtyTop;
+	frame.dirty_bottom = (uint8_t)dirtyBottom;
+	frames.publish();
+	published = frameNumber;
+	dirtyTop = dirtyBottom = 0;
+}
+
+//emulation thread, runs frames at 60Hz (or back to back with turbo) until quit is set or the machine
+//stops, handing frames, sound and recorded input back without ever waiting on the presenter; while
+//rewinding is set it steps back through the rewind history a frame at a time instead
+static void emulate(VChip8& chip8, unsigned int instructionsPerFrame, bool turbo, const VChip8SharedKeypad& keypad,
+                    VChip8TripleBuffer& frames, VChip8AudioRing& audioRing, VChip8Movie* movie, VChip8Capture* capture, VChip8Pacer& pacer,
+                    VChip8Rewind* rewind, const std::atomic<bool>& rewinding, const std::atomic<bool>& quit, std::atomic<bool>& stopped){
+	uint64_t frameNumber = 0; //frames handed out, keeps counting while rewinding
+	uint64_t published = UINT64_MAX; //number of the last published frame, none yet
+	unsigned int dirtyTop = 0, dirtyBottom = 0; //rows drawn since then
+	auto nextPublish = std::chrono::steady_clock::now();
+	if (rewind)
+		rewind->capture(chip8);
+	pacer.start();
+	while (!quit.load(std::memory_order_relaxed) && chip8.get_error_code() == VChip8::ALL_OKAY){
+		if (rewind && rewinding.load(std::memory_order_relaxed) && rewind->frames() > 1){
+			rewind->rewind(chip8, 1);
+		}
+		else{
+			//the whole frame runs as one batch with the keypad as it was at its start, timers tick once
+			keypad.load(chip8.keypad);
+			if (movie)
+				movie->record(frameNumber, chip8.keypad);
+			chip8.run_frame(instructionsPerFrame);
+			if (rewind)
+				rewind->capture(chip8);
+		}
+		++frameNumber;
+		collect_dirty_rows(chip8, dirtyTop, dirtyBottom);
+
+		//turbo still hands out frames and sound at 60Hz, the rest of its frames are never shown
+		auto now = std::chrono::steady_clock::now();
+		if (!turbo || now >= nextPublish){
+			nextPublish = now + FRAME_PERIOD;
+			publish_frame(chip8, frameNumber, frames, published, dirtyTop, dirtyBottom);
+			audioRing.push(VChip8AudioFrame::capture(chip8));
+			if (capture)
+				capture->submit(chip8, frameNumber);
+		}
+
+		//sleeps out the rest of the frame instead of spinning on the clock
+		if (!turbo)
+			pacer.wait();
+	}
+	//the presenter shows the final state before closing
+	publish_frame(chip8, frameNumber, frames, published, dirtyTop, dirtyBottom);
+	stopped.store(true, std::memory_order_release);
+}
 
 int main(int argc, char** argv){
    
-	if (argc != 4){
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+	bool turbo = false; //run frames back to back, still presenting at most 60 times a second
+	uint32_t seed = (uint32_t)std::chrono::system_clock::now().time_since_epoch().count();
+	char const* movieFilename = nullptr; //keypad of every frame is recorded here for VChip8Headless --replay
+	char const* captureFilename = nullptr; //shown frames are written here, see VChip8Headless --capture
+	VChip8::Mode mode = VChip8::MODE_CHIP8;
+	bool badArguments = argc < 4;
+	for (int i = 4; i < argc && !badArguments; i++){
+		if (std::strcmp(argv[i], "--turbo") == 0)
+			turbo = true;
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			movieFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			captureFilename = argv[++i];
+		else if (std::strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+			badArguments = !VChip8::parse_mode(argv[++i], mode);
+		else
+			badArguments = true;
+	}
+	if (badArguments){
+		std::cerr << "Usage: " << argv[0] << " <Scale> <Instructions per frame> <ROM> [--turbo] [--seed N] [--record MOVIE] [--capture FILE] [--mode chip8|schip|xochip]\n";
 		std::exit(EXIT_FAILURE);
 	}
 
     std::cout<<"Loading";
 	int videoScale = std::stoi(argv[1]);
-	int cycleDelay = std::stoi(argv[2]);
+	unsigned int instructionsPerFrame = std::stoul(argv[2]);
 	char const* romFilename = argv[3];
 	Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
-	VChip8 chip8;
+	//sound state goes from the emulation thread to SDL's audio thread through a lock-free ring
+	VChip8AudioRing audioRing;
+	VChip8AudioSynth synth(audioRing);
+	if (!platform.startAudio(synth))
+		std::cerr << "\nNo audio device, running without sound: " << SDL_GetError();
+	VChip8 chip8(seed);
+	chip8.set_mode(mode);
 	chip8.loadRom(romFilename);
-	int videoPitch = sizeof(chip8.video_memory[0]) * VIDEO_WIDTH;
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
-	bool quit = false;
+	VChip8Movie movie;
+	movie.seed = seed;
+	movie.instructions_per_frame = instructionsPerFrame;
+	movie.mode = mode;
 
 	if (chip8.get_error_code() != VChip8::ALL_OKAY){
 		std::cout<<"\n"<<chip8.get_error_name();
 		return -1;
 	}
 
-	while (!quit){
-		quit = platform.processInput(chip8.keypad);
+	//frames the capture can't keep up with are dropped rather than slowing the game down
+	VChip8Capture capture;
+	if (captureFilename){
+		VChip8Capture::Options captureOptions;
+		captureOptions.format = VChip8Capture::format_for(captureFilename);
+		captureOptions.mode = mode;
+		if (!capture.open(captureFilename, captureOptions)){
+			std::cout<<"\nCouldn't write "<<captureFilename;
+			return -1;
+		}
+	}
+
+	//this thread only polls input and presents, emulation runs on its own so a slow present
+	//(vsync, compositor) can't hold it up
+	VChip8SharedKeypad keypad;
+	VChip8TripleBuffer frames;
+	std::atomic<bool> quit{false};
+	std::atomic<bool> stopped{false};
+	VChip8Pacer pacer(FRAME_PERIOD);
+	//a recorded movie must replay frame for frame, so there is no going back while recording
+	std::unique_ptr<VChip8Rewind> rewind;
+	if (!movieFilename)
+		rewind.reset(new VChip8Rewind(REWIND_BUDGET));
+	std::atomic<bool> rewinding{false};
+	std::thread emulation(emulate, std::ref(chip8), instructionsPerFrame, turbo, std::cref(keypad), std::ref(frames),
+	                      std::ref(audioRing), movieFilename ? &movie : nullptr,
+	                      captureFilename ? &capture : nullptr, std::ref(pacer), rewind.get(),
+	                      std::cref(rewinding), std::cref(quit), std::ref(stopped));
+
+	uint8_t keys[16]{};
+	uint32_t frame[MAX_VIDEO_WIDTH * MAX_VIDEO_HEIGHT]{}; //RGBA copy of the display, only built when presenting
+	uint64_t shownNumber = 0; //the presented frame, new frames carry their rows changed since the frame before them
+	bool shownHires = false;
+	bool presented = false;
+	unsigned int width = VIDEO_WIDTH;
 
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
-         
-		if (dt > cycleDelay){
-			lastCycleTime = currentTime;
-			chip8.cycle();
-			platform.update(chip8.video_memory, videoPitch);
+	while (!quit.load(std::memory_order_relaxed)){
+		bool closed = platform.processInput(keys);
+		keypad.store(keys);
+		rewinding.store(platform.rewinding(), std::memory_order_relaxed);
+
+		//checked before acquire, so the final frame published before stopping is still presented
+		bool finished = stopped.load(std::memory_order_acquire);
+		if (!frames.acquire()){
+			platform.update(frame, sizeof(frame[0]) * width, 0, 0); //re-presents only if the window was exposed
+			if (closed || finished)
+				quit.store(true);
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
 		}
 
-		if (chip8.get_error_code() != VChip8::ALL_OKAY){
-			std::cout<<"\nAn error occurred: "<<chip8.get_error_code();
-			std::cout<<"\n"<<chip8.get_error_name();
-			return -1;
+		//only the rows the machine drew since the presented frame are expanded and uploaded; a frame
+		//that follows one the presenter never picked up is redrawn whole, as is a resolution switch,
+		//which also replaces the texture
+		const VChip8Frame& latest = frames.front();
+		width = latest.hires ? MAX_VIDEO_WIDTH : VIDEO_WIDTH;
+		unsigned int height = latest.hires ? MAX_VIDEO_HEIGHT : VIDEO_HEIGHT;
+		unsigned int wordsPerRow = width / 64;
+		unsigned int top = 0, bottom = height;
+		if (latest.hires != shownHires)
+			platform.resize(width, height);
+		else if (presented && latest.previous == shownNumber){
+			top = latest.dirty_top < height ? latest.dirty_top : height;
+			bottom = latest.dirty_bottom < height ? latest.dirty_bottom : height;
 		}
+		if (top < bottom){
+			if (latest.mode == VChip8::MODE_XOCHIP)
+				expand_planes(latest.video_memory + top * wordsPerRow, latest.video_memory + VChip8::PLANE_WORDS + top * wordsPerRow,
+				              (bottom - top) * wordsPerRow, frame + top * width, PLANE_PALETTE);
+			else
+				expand_pixels(latest.video_memory + top * wordsPerRow, (bottom - top) * wordsPerRow, frame + top * width);
+		}
+		platform.update(frame, sizeof(frame[0]) * width, top, bottom);
+		shownNumber = latest.number;
+		shownHires = latest.hires;
+		presented = true;
+
+		if (closed)
+			quit.store(true);
 	}
+	emulation.join();
+
+	if (!turbo){
+		VChip8Pacer::Stats timing = pacer.stats();
+		std::cout << "\nFrames: " << timing.frames << ", skipped: " << timing.skipped
+		          << ", lateness mean/jitter/max (us): " << timing.mean_lateness_us << "/" << timing.jitter_us
+		          << "/" << timing.max_lateness_us;
+	}
+
+	if (chip8.get_error_code() != VChip8::ALL_OKAY && chip8.get_error_code() != VChip8::PROGRAM_EXITED){
+		std::cout<<"\nAn error occurred: "<<chip8.get_error_code();
+		std::cout<<"\n"<<chip8.get_error_name();
+	}
+
+	if (captureFilename){
+		if (!capture.close())
+			std::cerr << "\nCouldn't write " << captureFilename;
+		else
+			std::cout << "\nCaptured " << capture.written() << " frames, " << capture.dropped() << " dropped";
+	}
+
+	if (movieFilename && !movie.save(movieFilename))
+		std::cerr << "\nCouldn't write the movie to " << movieFilename;
 
-	return 0;
+	return chip8.get_error_code() == VChip8::ALL_OKAY || chip8.get_error_code() == VChip8::PROGRAM_EXITED ? 0 : -1;
 }
@@ -0,0 +1,129 @@
+#include "../include/movie.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+    uint16_t pack_keys(const uint8_t* keypad){
+        uint16_t keys = 0;
+        for (unsigned int k = 0; k < 16; k++){
+            if (keypad[k])
+                keys |= 1u << k;
+        }
+        return keys;
+    }
+
+    void put(std::vector<uint8_t>& out, uint64_t value, unsigned int bytes){
+        for (unsigned int i = 0; i < bytes; i++)
+            out.push_back((value >> (8 * i)) & 0xFFu);
+    }
+
+    bool get(const std::vector<uint8_t>& in, size_t& p, uint64_t& value, unsigned int bytes){
+        if (in.size() - p < bytes)
+            return false;
+        value = 0;
+        for (unsigned int i = 0; i < bytes; i++)
+            value |= (uint64_t)in[p++] << (8 * i);
+        return true;
+    }
+
+}
+
+void VChip8Movie::record(uint64_t frame, const uint8_t* keypad){
+    uint16_t keys = pack_keys(keypad);
+    uint16_t previous = this->events.empty() ? 0 : this->events.back().keys;
+    if (keys != previous)
+        this->events.push_back(Event{frame, keys});
+    if (frame + 1 > this->frame_count)
+        this->frame_count = frame + 1;
+}
+
+void VChip8Movie::apply(uint64_t frame, uint8_t* keypad){
+    if (this->cursor > 0 && this->events[this->cursor - 1].frame > frame){
+        this->cursor = 0;
+        this->current = 0;
+    }
+    while (this->cursor < this->events.size() && this->events[this->cursor].frame <= frame)
+        this->current = this->events[this->cursor++].keys;
+
+    for (unsigned int k = 0; k < 16; k++)
+        keypad[k] = (this->current >> k) & 1u;
+}
+
+uint64_t VChip8Movie::next_event(uint64_t frame) const{
+    auto next = std::upper_bound(this->events.begin(), this->events.end(), frame,
+                                 [](uint64_t f, const Event& event){ return f < event.frame; });
+    return next != this->events.end() ? next->frame : UINT64_MAX;
+}
+
+uint64_t VChip8Movie::frames() const{
+    return this->frame_count;
+}
+
+bool VChip8Movie::save(const char* file_path) const{
+    std::vector<uint8_t> out = { 'V', 'C', '8', 'M', VERSION };
+    put(out, this->instructions_per_frame, 4);
+    put(out, this->seed, 4);
+    put(out, this->frame_count, 8);
+    put(out, this->mode, 1);
+
+    uint64_t last = 0;
+    for (const Event& event : this->events){
+        uint64_t delta = event.frame - last;
+        last = event.frame;
+        do{
+            out.push_back((delta & 0x7Fu) | (delta > 0x7Fu ? 0x80u : 0));
+            delta >>= 7;
+        } while (delta > 0);
+        put(out, event.keys, 2);
+    }
+
+    std::ofstream file(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return file.good();
+}
+
+bool VChip8Movie::load(const char* file_path){
+    std::ifstream file(file_path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+    std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (in.size() < 5 || in[0] != 'V' || in[1] != 'C' || in[2] != '8' || in[3] != 'M' || in[4] != VERSION)
+        return false;
+
+    size_t p = 5;
+    uint64_t ipf, seed, frames, mode;
+    if (!get(in, p, ipf, 4) || !get(in, p, seed, 4) || !get(in, p, frames, 8) || !get(in, p, mode, 1))
+        return false;
+
+    std::vector<Event> events;
+    uint64_t frame = 0;
+    while (p < in.size()){
+        uint64_t delta = 0;
+        for (unsigned int shift = 0; ; shift += 7){
+            if (p >= in.size() || shift > 63)
+                return false;
+            delta |= (uint64_t)(in[p] & 0x7Fu) << shift;
+            if (!(in[p++] & 0x80u))
+                break;
+        }
+        uint64_t keys;
+        if (!get(in, p, keys, 2))
+            return false;
+        frame += delta;
+        events.push_back(Event{frame, (uint16_t)keys});
+    }
+
+    this->instructions_per_frame = (uint32_t)ipf;
+    this->seed = (uint32_t)seed;
+    this->frame_count = frames;
+    this->mode = (uint8_t)mode;
+    this->events.swap(events);
+    this->cursor = 0;
+    this->current = 0;
+    return true;
+}
@@ -0,0 +1,82 @@
+#include "../include/pacer.hpp"
+#include <cmath>
+#include <thread>
+
+#if defined(__unix__)
+#include <cerrno>
+#include <time.h>
+#define VCHIP8_CLOCK_NANOSLEEP 1
+#endif
+
+VChip8Pacer::VChip8Pacer(std::chrono::nanoseconds period, std::chrono::nanoseconds spin, unsigned int max_behind){
+    this->period = period.count() > 0 ? period.count() : 1;
+    this->spin = spin.count() > 0 ? spin.count() : 0;
+    this->max_behind = max_behind > 0 ? max_behind : 1;
+    start();
+}
+
+int64_t VChip8Pacer::now(){
+#ifdef VCHIP8_CLOCK_NANOSLEEP
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void VChip8Pacer::sleep_until(int64_t time){
+#ifdef VCHIP8_CLOCK_NANOSLEEP
+    //an absolute deadline, a signal only means sleeping again for the rest
+    timespec until;
+    until.tv_sec = time / 1000000000;
+    until.tv_nsec = time % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR){
+    }
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(time)));
+#endif
+}
+
+void VChip8Pacer::start(){
+    this->deadline = now() + this->period;
+}
+
+void VChip8Pacer::wait(){
+    int64_t current = now();
+    if (current - this->deadline > (int64_t)this->max_behind * this->period){
+        //too far behind, start over from now instead of running the missed frames back to back
+        this->skipped += (current - this->deadline) / this->period;
+        this->deadline = current;
+    }
+
+    //the kernel wakes us a little late, so sleep to just before the deadline and spin the rest
+    if (this->deadline - this->spin > current)
+        sleep_until(this->deadline - this->spin);
+    do{
+        current = now();
+    } while (current < this->deadline);
+
+    int64_t lateness = current - this->deadline;
+    ++this->frames;
+    this->lateness_sum += lateness;
+    this->lateness_squares += (double)lateness * lateness;
+    if (lateness > this->lateness_max)
+        this->lateness_max = lateness;
+
+    this->deadline += this->period;
+}
+
+VChip8Pacer::Stats VChip8Pacer::stats() const{
+    Stats stats{};
+    stats.frames = this->frames;
+    stats.skipped = this->skipped;
+    if (this->frames > 0){
+        double mean = this->lateness_sum / this->frames;
+        double variance = this->lateness_squares / this->frames - mean * mean;
+        stats.mean_lateness_us = mean / 1000.0;
+        stats.jitter_us = std::sqrt(variance > 0 ? variance : 0) / 1000.0;
+        stats.max_lateness_us = this->lateness_max / 1000.0;
+    }
+    return stats;
+}
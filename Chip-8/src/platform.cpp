@@ -1,7 +1,8 @@
 #include "../include/platform.hpp"
 
 Platform::Platform(const char* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight){
-    SDL_Init(SDL_INIT_VIDEO);
+    this->textureWidth = textureWidth;
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
     window  = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
 
@@ -12,19 +13,65 @@ Platform::Platform(const char* title, int windowWidth, int windowHeight, int tex
 }
 
 Platform::~Platform(){
+    if (this->audioDevice)
+        SDL_CloseAudioDevice(this->audioDevice);
     SDL_DestroyTexture(this->texture);
     SDL_DestroyRenderer(this->renderer);
     SDL_DestroyWindow(this->window);
     SDL_Quit();
 }
 
-void Platform::update(void const* buffer, int pitch){
-    SDL_UpdateTexture(this->texture, nullptr, buffer, pitch);
+void Platform::update(void const* buffer, int pitch, int top, int bottom){
+    //unchanged frame, the texture and the window already show it
+    if (top >= bottom && !this->exposed)
+        return;
+
+    if (top < bottom){
+        //only the dirty rows are uploaded, the rest of the texture keeps the previous frame
+        SDL_Rect rows{0, top, this->textureWidth, bottom - top};
+        SDL_UpdateTexture(this->texture, &rows, static_cast<const uint8_t*>(buffer) + top * pitch, pitch);
+    }
+    this->exposed = false;
+
     SDL_RenderClear(this->renderer);
     SDL_RenderCopy(this->renderer, this->texture, nullptr, nullptr);
 	SDL_RenderPresent(this->renderer);
 }
 
+void Platform::resize(int textureWidth, int textureHeight){
+    SDL_DestroyTexture(this->texture);
+    this->textureWidth = textureWidth;
+    texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+    this->exposed = true;
+}
+
+namespace {
+
+    //SDL's audio thread, the synth only touches the ring's atomics and its own state
+    void audioCallback(void* userdata, Uint8* stream, int length){
+        static_cast<VChip8AudioSynth*>(userdata)->render(reinterpret_cast<int16_t*>(stream), length / sizeof(int16_t));
+    }
+
+}
+
+bool Platform::startAudio(VChip8AudioSynth& synth){
+    SDL_AudioSpec wanted{};
+    wanted.freq = synth.get_sample_rate();
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = 512;   //~12ms per callback at 44.1kHz
+    wanted.callback = audioCallback;
+    wanted.userdata = &synth;
+
+    //no changes allowed, SDL converts to whatever the device plays
+    SDL_AudioSpec obtained{};
+    this->audioDevice = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+    if (!this->audioDevice)
+        return false;
+    SDL_PauseAudioDevice(this->audioDevice, 0);
+    return true;
+}
 
 bool Platform::processInput(uint8_t* keys){
 	bool quit = false;
@@ -37,6 +84,11 @@ bool Platform::processInput(uint8_t* keys){
 			{
 				quit = true;
 			} break;
+			case SDL_WINDOWEVENT:
+			{
+				if (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					this->exposed = true;
+			} break;
 			case SDL_KEYDOWN:
 			{
 				switch (event.key.keysym.sym)
@@ -45,6 +97,10 @@ bool Platform::processInput(uint8_t* keys){
 					{
 						quit = true;
 					} break;
+					case SDLK_BACKSPACE:
+					{
+						this->rewindHeld = true;
+					} break;
 					case SDLK_x:
 					{
 						keys[0] = 1;
@@ -115,6 +171,10 @@ bool Platform::processInput(uint8_t* keys){
 			{
 				switch (event.key.keysym.sym)
 				{
+					case SDLK_BACKSPACE:
+					{
+						this->rewindHeld = false;
+					} break;
 					case SDLK_x:
 					{
 						keys[0] = 0;
@@ -185,3 +245,7 @@ bool Platform::processInput(uint8_t* keys){
 	}
 	return quit;
 }
+
+bool Platform::rewinding() const{
+	return this->rewindHeld;
+}
@@ -0,0 +1,88 @@
+#include "../include/chip_8.hpp"
+
+//Reports of the execution profile, the counters themselves live in chip_8.cpp.
+//Empty unless the core is built with the VCHIP8_PROFILE option.
+
+#ifdef VCHIP8_PROFILE
+
+#include <cstring>
+#include <iomanip>
+
+namespace {
+
+    void address(std::ostream& out, unsigned int value){
+        out << "0x" << std::hex << std::setw(3) << std::setfill('0') << value << std::dec << std::setfill(' ');
+    }
+
+}
+
+void VChip8Machine::reset_profile(){
+    std::memset(&this->profile, 0, sizeof(this->profile));
+}
+
+void VChip8Machine::write_profile_json(std::ostream& out) const{
+    uint64_t total = 0;
+    for (unsigned int id = 0; id < ID_COUNT; id++)
+        total += this->profile.opcode_counts[id];
+
+    out << "{\n  \"instructions\": " << total
+        << ",\n  \"draw_nanoseconds\": " << this->profile.draw_nanoseconds
+        << ",\n  \"draw_count\": " << this->profile.opcode_counts[ID_Dxyn]
+        << ",\n  \"opcodes\": {";
+    const char* separator = "\n";
+    for (unsigned int id = 0; id < ID_COUNT; id++){
+        if (this->profile.opcode_counts[id] == 0)
+            continue;
+        out << separator << "    \"" << instr_names[id] << "\": " << this->profile.opcode_counts[id];
+        separator = ",\n";
+    }
+
+    out << "\n  },\n  \"addresses\": {";
+    separator = "\n";
+    for (unsigned int pc = 0; pc < this->memory_size(); pc++){
+        if (this->profile.pc_counts[pc] == 0)
+            continue;
+        out << separator << "    \"";
+        address(out, pc);
+        out << "\": " << this->profile.pc_counts[pc];
+        separator = ",\n";
+    }
+
+    out << "\n  },\n  \"calls\": {";
+    separator = "\n";
+    for (unsigned int pc = 0; pc < this->memory_size(); pc++){
+        if (this->profile.call_counts[pc] == 0)
+            continue;
+        out << separator << "    \"";
+        address(out, pc);
+        out << "\": " << this->profile.call_counts[pc];
+        separator = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+void VChip8Machine::write_profile_collapsed(std::ostream& out, const char* root) const{
+    unsigned int subroutine = MEMORY_SIZE; //none called below the current address yet
+    for (unsigned int pc = 0; pc < this->memory_size(); pc++){
+        if (this->profile.call_counts[pc] != 0)
+            subroutine = pc;
+        if (this->profile.pc_counts[pc] == 0)
+            continue;
+
+        //the opcode currently in memory, self-modifying code reports its latest contents
+        uint16_t opcode = (this->memory[pc] << 8u) | this->memory[(pc + 1) & this->address_mask];
+        out << root << ";";
+        if (subroutine == MEMORY_SIZE){
+            out << "main";
+        }
+        else{
+            out << "sub_";
+            address(out, subroutine);
+        }
+        out << ";";
+        address(out, pc);
+        out << "_" << instr_names[decode(opcode).id] << " " << this->profile.pc_counts[pc] << "\n";
+    }
+}
+
+#endif
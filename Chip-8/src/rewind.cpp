@@ -0,0 +1,186 @@
+#include "../include/rewind.hpp"
+#include <cstring>
+
+namespace {
+
+    //run lengths of the delta encoding are 16-bit, longer runs take several tokens
+    constexpr size_t MAX_RUN = 0xFFFF;
+
+}
+
+VChip8Rewind::VChip8Rewind(size_t budget, unsigned int keyframe_interval){
+    this->ring.resize(budget);
+    this->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+    this->next_sequence = 0;
+    this->used = 0;
+    this->keyframe = VChip8::Snapshot{};
+    //worst case of the encoding, a token per five bytes
+    this->scratch.resize(2 * sizeof(VChip8::Snapshot) + 16);
+}
+
+size_t VChip8Rewind::encode(const uint8_t* current, const uint8_t* key, size_t size, uint8_t* out){
+    //tokens of (equal bytes to skip, bytes to XOR) as 16-bit counts, followed by the XOR bytes,
+    //equal runs shorter than a token are kept inside the literal
+    size_t i = 0, o = 0;
+    while (i < size){
+        size_t zeros = 0;
+        while (i < size && zeros < MAX_RUN && current[i] == key[i]){
+            ++zeros;
+            ++i;
+        }
+        if (i == size)
+            break;
+
+        size_t start = i;
+        while (i < size && i - start < MAX_RUN){
+            if (current[i] != key[i]){
+                ++i;
+                continue;
+            }
+            size_t run = i;
+            while (run < size && run - i < 4 && current[run] == key[run])
+                ++run;
+            if (run - i == 4 || run == size || run - start > MAX_RUN)
+                break;
+            i = run;
+        }
+
+        size_t literal = i - start;
+        out[o++] = zeros & 0xFFu;
+        out[o++] = zeros >> 8;
+        out[o++] = literal & 0xFFu;
+        out[o++] = literal >> 8;
+        for (size_t k = start; k < i; k++)
+            out[o++] = current[k] ^ key[k];
+    }
+    return o;
+}
+
+void VChip8Rewind::decode(const uint8_t* in, size_t size, uint8_t* state){
+    size_t p = 0, position = 0;
+    while (p < size){
+        size_t zeros = in[p] | (in[p + 1] << 8);
+        size_t literal = in[p + 2] | (in[p + 3] << 8);
+        p += 4;
+        position += zeros;
+        for (size_t k = 0; k < literal; k++)
+            state[position++] ^= in[p++];
+    }
+}
+
+void VChip8Rewind::drop_oldest(){
+    //a keyframe goes together with every delta encoded against it
+    do{
+        this->used -= this->records.front().size;
+        this->records.pop_front();
+    } while (!this->records.empty() && this->records.front().sequence != this->records.front().keyframe);
+}
+
+size_t VChip8Rewind::allocate(size_t size, bool keep_keyframe){
+    for (;;){
+        if (this->records.empty())
+            return size <= this->ring.size() ? 0 : NO_SPACE;
+
+        size_t head = this->records.front().offset;
+        size_t tail = this->records.back().offset + this->records.back().size;
+        if (tail > head){
+            //free space at the end and in front of the oldest record, records never wrap
+            if (tail + size <= this->ring.size())
+                return tail;
+            if (size <= head)
+                return 0;
+        }
+        else if (tail + size <= head){
+            return tail;
+        }
+
+        //a delta cannot outlive its keyframe
+        if (keep_keyframe && this->records.front().sequence == this->records.back().keyframe)
+            return NO_SPACE;
+        drop_oldest();
+    }
+}
+
+void VChip8Rewind::store(const uint8_t* bytes, size_t size, uint64_t keyframe){
+    Record record;
+    record.offset = allocate(size, keyframe != this->next_sequence);
+    record.size = size;
+    record.sequence = this->next_sequence;
+    record.keyframe = keyframe;
+    if (record.offset == NO_SPACE)
+        return;
+
+    std::memcpy(&this->ring[record.offset], bytes, size);
+    this->records.push_back(record);
+    this->used += size;
+    ++this->next_sequence;
+}
+
+void VChip8Rewind::capture(const VChip8Machine& chip8){
+    VChip8::Snapshot state;
+    chip8.snapshot(state);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+
+    if (!this->records.empty()){
+        const Record& newest = this->records.back();
+        if (newest.sequence - newest.keyframe + 1 < this->keyframe_interval){
+            size_t size = encode(bytes, reinterpret_cast<const uint8_t*>(&this->keyframe), sizeof(state), this->scratch.data());
+            uint64_t before = this->next_sequence;
+            if (size < sizeof(state))
+                store(this->scratch.data(), size, newest.keyframe);
+            //stored unless the ring only had room for the keyframe's own group
+            if (this->next_sequence != before)
+                return;
+        }
+    }
+
+    //a new keyframe, if it does not fit the budget is too small to keep any history
+    this->keyframe = state;
+    uint64_t before = this->next_sequence;
+    store(bytes, sizeof(state), this->next_sequence);
+    if (this->next_sequence == before)
+        clear();
+}
+
+size_t VChip8Rewind::frames() const{
+    return this->records.size();
+}
+
+bool VChip8Rewind::seek(size_t back, VChip8::Snapshot& state) const{
+    if (back >= this->records.size())
+        return false;
+
+    //the oldest record is always a keyframe, so the frame's keyframe is still stored
+    const Record& record = this->records[this->records.size() - 1 - back];
+    const Record& key = this->records[record.keyframe - this->records.front().sequence];
+    std::memcpy(&state, &this->ring[key.offset], sizeof(state));
+    if (record.sequence != record.keyframe)
+        decode(&this->ring[record.offset], record.size, reinterpret_cast<uint8_t*>(&state));
+    return true;
+}
+
+bool VChip8Rewind::rewind(VChip8Machine& chip8, size_t back){
+    VChip8::Snapshot state;
+    if (!seek(back, state))
+        return false;
+    chip8.restore(state);
+
+    for (size_t i = 0; i < back; i++){
+        this->used -= this->records.back().size;
+        this->records.pop_back();
+    }
+    const Record& newest = this->records.back();
+    const Record& key = this->records[newest.keyframe - this->records.front().sequence];
+    std::memcpy(&this->keyframe, &this->ring[key.offset], sizeof(this->keyframe));
+    this->next_sequence = newest.sequence + 1;
+    return true;
+}
+
+void VChip8Rewind::clear(){
+    this->records.clear();
+    this->used = 0;
+}
+
+size_t VChip8Rewind::memory_used() const{
+    return this->used;
+}
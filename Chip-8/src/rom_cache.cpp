@@ -0,0 +1,172 @@
+#include "../include/rom_cache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VCHIP8_ROM_POSIX 1
+#endif
+
+namespace {
+
+    uint64_t content_hash(const uint8_t* bytes, size_t size){
+        //64-bit FNV-1a, same as the frame and state hashes
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; i++){
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+}
+
+const uint8_t* VChip8RomImage::data() const{
+    return this->buffer.data();
+}
+
+size_t VChip8RomImage::size() const{
+    return this->buffer.size();
+}
+
+uint64_t VChip8RomImage::hash() const{
+    return this->content_hash;
+}
+
+const std::string& VChip8RomImage::path() const{
+    return this->file_path;
+}
+
+VChip8RomCache& VChip8RomCache::shared(){
+    static VChip8RomCache cache;
+    return cache;
+}
+
+std::shared_ptr<const VChip8RomImage> VChip8RomCache::open(const char* file_path){
+    //size and modification time come from the file that is actually read, not from a lookup of its path
+    uint64_t fileSize;
+    int64_t modified;
+#ifdef VCHIP8_ROM_POSIX
+    int fd = ::open(file_path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)){
+        ::close(fd);
+        return nullptr;
+    }
+    fileSize = (uint64_t)status.st_size;
+    modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#else
+    std::error_code error;
+    std::filesystem::path path(file_path);
+    fileSize = std::filesystem::file_size(path, error);
+    if (error)
+        return nullptr;
+    modified = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (error)
+        return nullptr;
+#endif
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        auto cached = this->by_path.find(file_path);
+        if (cached != this->by_path.end() && cached->second.file_size == fileSize && cached->second.modified == modified){
+#ifdef VCHIP8_ROM_POSIX
+            ::close(fd);
+#endif
+            return cached->second.image;
+        }
+    }
+
+    //the file is read outside the lock, a concurrent open of the same file ends up on the same image in intern()
+    std::unique_ptr<VChip8RomImage> image(new VChip8RomImage());
+    image->file_path = file_path;
+#ifdef VCHIP8_ROM_POSIX
+    //a file that shrank since fstat() just yields fewer bytes
+    image->buffer.resize(fileSize);
+    size_t filled = 0;
+    while (filled < image->buffer.size()){
+        ssize_t count = ::read(fd, image->buffer.data() + filled, image->buffer.size() - filled);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        filled += (size_t)count;
+    }
+    ::close(fd);
+    image->buffer.resize(filled);
+#else
+    std::ifstream file(file_path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return nullptr;
+    image->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#endif
+    image->content_hash = content_hash(image->buffer.data(), image->buffer.size());
+
+    std::shared_ptr<const VChip8RomImage> shared = intern(std::move(image));
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->by_path[file_path] = PathEntry{ fileSize, modified, shared };
+    return shared;
+}
+
+std::shared_ptr<const VChip8RomImage> VChip8RomCache::intern(std::unique_ptr<VChip8RomImage> image){
+    std::lock_guard<std::mutex> guard(this->lock);
+    //a hash match is confirmed byte by byte, a collision just adds a second image to the bucket
+    std::vector<std::shared_ptr<const VChip8RomImage>>& bucket = this->by_hash[image->content_hash];
+    for (const std::shared_ptr<const VChip8RomImage>& existing : bucket){
+        if (existing->size() == image->size() && std::memcmp(existing->data(), image->data(), image->size()) == 0)
+            return existing;
+    }
+    bucket.push_back(std::shared_ptr<const VChip8RomImage>(image.release()));
+    return bucket.back();
+}
+
+bool VChip8RomCache::is_rom_file(const std::string& path){
+    static const char* const extensions[] = { ".ch8", ".sc8", ".xo8" };
+    for (const char* extension : extensions){
+        size_t length = std::strlen(extension);
+        if (path.size() > length && path.compare(path.size() - length, length, extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::vector<VChip8RomFile> VChip8RomCache::open_directory(const char* directory){
+    //golden files, movies and the like are never read
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)){
+        if (it->is_regular_file(error) && is_rom_file(it->path().string()))
+            paths.push_back(it->path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<VChip8RomFile> files;
+    for (const std::string& path : paths){
+        std::shared_ptr<const VChip8RomImage> image = open(path.c_str());
+        if (image)
+            files.push_back(VChip8RomFile{ path, image });
+    }
+    return files;
+}
+
+size_t VChip8RomCache::size() const{
+    std::lock_guard<std::mutex> guard(this->lock);
+    size_t count = 0;
+    for (const auto& bucket : this->by_hash)
+        count += bucket.second.size();
+    return count;
+}
+
+void VChip8RomCache::clear(){
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->by_path.clear();
+    this->by_hash.clear();
+}
@@ -0,0 +1,149 @@
+#include "../include/runner.hpp"
+#include <thread>
+
+namespace {
+
+    uint64_t pack(uint32_t begin, uint32_t end){
+        return (uint64_t)end << 32 | begin;
+    }
+
+    uint32_t range_begin(uint64_t bounds){
+        return (uint32_t)bounds;
+    }
+
+    uint32_t range_end(uint64_t bounds){
+        return (uint32_t)(bounds >> 32);
+    }
+
+}
+
+VChip8Runner::VChip8Runner(unsigned int threads){
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    this->threads = threads > 0 ? threads : 1;
+}
+
+VChip8& VChip8Runner::add(){
+    this->instances.push_back(std::unique_ptr<VChip8>(new VChip8()));
+    this->inputs.push_back(nullptr);
+    return *this->instances.back();
+}
+
+void VChip8Runner::set_checkpoints(uint64_t every){
+    this->checkpoint_interval = every;
+}
+
+void VChip8Runner::set_input(size_t index, const VChip8Movie& movie){
+    this->inputs[index].reset(new VChip8Movie(movie));
+}
+
+size_t VChip8Runner::size() const{
+    return this->instances.size();
+}
+
+unsigned int VChip8Runner::thread_count() const{
+    return this->threads;
+}
+
+VChip8& VChip8Runner::instance(size_t index){
+    return *this->instances[index];
+}
+
+const std::vector<VChip8Runner::Result>& VChip8Runner::results() const{
+    return this->slots;
+}
+
+bool VChip8Runner::take(Range& own, uint32_t& index){
+    //the owner takes from the front
+    uint64_t bounds = own.bounds.load(std::memory_order_acquire);
+    while (range_begin(bounds) < range_end(bounds)){
+        if (own.bounds.compare_exchange_weak(bounds, pack(range_begin(bounds) + 1, range_end(bounds)),
+                                             std::memory_order_acq_rel)){
+            index = range_begin(bounds);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VChip8Runner::steal(Range& own, Range& victim, uint32_t& index){
+    //a thief takes the back half of the victim's range, keeps the first index for itself
+    //and publishes the rest as its own range, which nobody else can grow while it is empty
+    uint64_t bounds = victim.bounds.load(std::memory_order_acquire);
+    while (range_begin(bounds) < range_end(bounds)){
+        uint32_t begin = range_begin(bounds);
+        uint32_t end = range_end(bounds);
+        uint32_t split = end - (end - begin + 1) / 2;
+        if (victim.bounds.compare_exchange_weak(bounds, pack(begin, split), std::memory_order_acq_rel)){
+            index = split;
+            own.bounds.store(pack(split + 1, end), std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+void VChip8Runner::work(std::vector<Range>& ranges, unsigned int worker, uint64_t frames, unsigned int instructionsPerFrame){
+    unsigned int workers = (unsigned int)ranges.size();
+    for (;;){
+        uint32_t index;
+        bool found = take(ranges[worker], index);
+        for (unsigned int i = 1; !found && i < workers; i++)
+            found = steal(ranges[worker], ranges[(worker + i) % workers], index);
+        //nothing left anywhere, ranges only ever shrink once handed out
+        if (!found)
+            return;
+
+        VChip8& chip8 = *this->instances[index];
+        Result& result = this->slots[index];
+        result = Result{};
+        VChip8Movie* input = this->inputs[index].get();
+        while (result.frames < frames && chip8.get_error_code() == VChip8::ALL_OKAY){
+            if (input)
+                input->apply(result.frames, chip8.keypad);
+            if (!chip8.wake()){
+                //parked until the next key event, the frames in between would only tick the timers
+                uint64_t wake = input ? input->next_event(result.frames) : frames;
+                if (wake > frames)
+                    wake = frames;
+                chip8.tick_timers(wake - result.frames);
+                //the display doesn't change while parked, the checkpoints skipped over all see this frame
+                if (this->checkpoint_interval){
+                    uint64_t hash = chip8.get_frame_hash();
+                    for (uint64_t c = result.frames / this->checkpoint_interval + 1; c * this->checkpoint_interval <= wake; c++)
+                        result.checkpoints.push_back(hash);
+                }
+                result.parked_frames += wake - result.frames;
+                result.frames = wake;
+                continue;
+            }
+            result.instructions += chip8.run_frame(instructionsPerFrame);
+            ++result.frames;
+            if (this->checkpoint_interval && result.frames % this->checkpoint_interval == 0)
+                result.checkpoints.push_back(chip8.get_frame_hash());
+        }
+        result.frame_hash = chip8.get_frame_hash();
+        result.error_code = chip8.get_error_code();
+    }
+}
+
+void VChip8Runner::run(uint64_t frames, unsigned int instructionsPerFrame){
+    uint32_t count = (uint32_t)this->instances.size();
+    this->slots.assign(count, Result{});
+
+    unsigned int workers = this->threads < count ? this->threads : count;
+    if (workers == 0)
+        return;
+
+    //equal contiguous shares up front, stealing evens out instances that finish early
+    std::vector<Range> ranges(workers);
+    for (unsigned int w = 0; w < workers; w++)
+        ranges[w].bounds.store(pack((uint64_t)count * w / workers, (uint64_t)count * (w + 1) / workers));
+
+    std::vector<std::thread> pool;
+    for (unsigned int w = 1; w < workers; w++)
+        pool.emplace_back(&VChip8Runner::work, this, std::ref(ranges), w, frames, instructionsPerFrame);
+    work(ranges, 0, frames, instructionsPerFrame);
+    for (std::thread& thread : pool)
+        thread.join();
+}
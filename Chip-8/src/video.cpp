@@ -0,0 +1,233 @@
+#include "../include/video.hpp"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void expand_pixels(const uint64_t* rows, unsigned int count, uint32_t* rgba, uint32_t on, uint32_t off){
+#if defined(__AVX2__)
+    //8 pixels per step, every lane tests its own bit of the current byte
+    const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i onColor = _mm256_set1_epi32((int)on);
+    const __m256i offColor = _mm256_set1_epi32((int)off);
+    for (unsigned int row = 0; row < count; row++){
+        uint64_t pixels = rows[row];
+        for (int byte = 7; byte >= 0; byte--){
+            __m256i value = _mm256_set1_epi32((int)((pixels >> (8 * byte)) & 0xFFu));
+            __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(value, bits), bits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba), _mm256_blendv_epi8(offColor, onColor, mask));
+            rgba += 8;
+        }
+    }
+#elif defined(__SSE2__)
+    //4 pixels per step, every lane tests its own bit of the current nibble
+    const __m128i bits = _mm_setr_epi32(0x8, 0x4, 0x2, 0x1);
+    const __m128i onColor = _mm_set1_epi32((int)on);
+    const __m128i offColor = _mm_set1_epi32((int)off);
+    for (unsigned int row = 0; row < count; row++){
+        uint64_t pixels = rows[row];
+        for (int nibble = 15; nibble >= 0; nibble--){
+            __m128i value = _mm_set1_epi32((int)((pixels >> (4 * nibble)) & 0xFu));
+            __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(value, bits), bits);
+            __m128i color = _mm_or_si128(_mm_and_si128(mask, onColor), _mm_andnot_si128(mask, offColor));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), color);
+            rgba += 4;
+        }
+    }
+#else
+    for (unsigned int row = 0; row < count; row++){
+        uint64_t pixels = rows[row];
+        for (int col = 63; col >= 0; col--){
+            *rgba++ = ((pixels >> col) & 1u) ? on : off;
+        }
+    }
+#endif
+}
+
+void expand_planes(const uint64_t* plane0, const uint64_t* plane1, unsigned int count, uint32_t* rgba,
+                   const uint32_t palette[4]){
+#if defined(__AVX2__)
+    //8 pixels per step, plane 0 picks within the pairs of colours and plane 1 between them
+    const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i color0 = _mm256_set1_epi32((int)palette[0]);
+    const __m256i color1 = _mm256_set1_epi32((int)palette[1]);
+    const __m256i color2 = _mm256_set1_epi32((int)palette[2]);
+    const __m256i color3 = _mm256_set1_epi32((int)palette[3]);
+    for (unsigned int word = 0; word < count; word++){
+        uint64_t low = plane0[word], high = plane1[word];
+        for (int byte = 7; byte >= 0; byte--){
+            __m256i value0 = _mm256_set1_epi32((int)((low >> (8 * byte)) & 0xFFu));
+            __m256i value1 = _mm256_set1_epi32((int)((high >> (8 * byte)) & 0xFFu));
+            __m256i mask0 = _mm256_cmpeq_epi32(_mm256_and_si256(value0, bits), bits);
+            __m256i mask1 = _mm256_cmpeq_epi32(_mm256_and_si256(value1, bits), bits);
+            __m256i lowPair = _mm256_blendv_epi8(color0, color1, mask0);
+            __m256i highPair = _mm256_blendv_epi8(color2, color3, mask0);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba), _mm256_blendv_epi8(lowPair, highPair, mask1));
+            rgba += 8;
+        }
+    }
+#elif defined(__SSE2__)
+    //4 pixels per step
+    const __m128i bits = _mm_setr_epi32(0x8, 0x4, 0x2, 0x1);
+    const __m128i color0 = _mm_set1_epi32((int)palette[0]);
+    const __m128i color1 = _mm_set1_epi32((int)palette[1]);
+    const __m128i color2 = _mm_set1_epi32((int)palette[2]);
+    const __m128i color3 = _mm_set1_epi32((int)palette[3]);
+    for (unsigned int word = 0; word < count; word++){
+        uint64_t low = plane0[word], high = plane1[word];
+        for (int nibble = 15; nibble >= 0; nibble--){
+            __m128i value0 = _mm_set1_epi32((int)((low >> (4 * nibble)) & 0xFu));
+            __m128i value1 = _mm_set1_epi32((int)((high >> (4 * nibble)) & 0xFu));
+            __m128i mask0 = _mm_cmpeq_epi32(_mm_and_si128(value0, bits), bits);
+            __m128i mask1 = _mm_cmpeq_epi32(_mm_and_si128(value1, bits), bits);
+            __m128i lowPair = _mm_or_si128(_mm_and_si128(mask0, color1), _mm_andnot_si128(mask0, color0));
+            __m128i highPair = _mm_or_si128(_mm_and_si128(mask0, color3), _mm_andnot_si128(mask0, color2));
+            __m128i color = _mm_or_si128(_mm_and_si128(mask1, highPair), _mm_andnot_si128(mask1, lowPair));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), color);
+            rgba += 4;
+        }
+    }
+#else
+    for (unsigned int word = 0; word < count; word++){
+        uint64_t low = plane0[word], high = plane1[word];
+        for (int col = 63; col >= 0; col--){
+            *rgba++ = palette[((low >> col) & 1u) | (((high >> col) & 1u) << 1)];
+        }
+    }
+#endif
+}
+
+namespace {
+
+    //one source row widened by factor into dst
+    void widen_row(const uint32_t* src, unsigned int width, unsigned int factor, uint32_t* dst){
+#if defined(__SSE2__)
+        if (factor == 2){
+            unsigned int x = 0;
+            for (; x + 4 <= width; x += 4){
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * x), _mm_unpacklo_epi32(pixels, pixels));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * x + 4), _mm_unpackhi_epi32(pixels, pixels));
+            }
+            for (; x < width; x++)
+                dst[2 * x] = dst[2 * x + 1] = src[x];
+            return;
+        }
+        if (factor >= 4){
+            //4 copies per store, the last store overlaps the previous one instead of a scalar tail
+            for (unsigned int x = 0; x < width; x++){
+                __m128i pixel = _mm_set1_epi32((int)src[x]);
+                uint32_t* block = dst + x * factor;
+                for (unsigned int i = 0; i + 4 <= factor; i += 4)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(block + i), pixel);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + factor - 4), pixel);
+            }
+            return;
+        }
+#endif
+        for (unsigned int x = 0; x < width; x++){
+            for (unsigned int i = 0; i < factor; i++)
+                dst[x * factor + i] = src[x];
+        }
+    }
+
+    //halves R, G and B of a row, the alpha byte (lowest, RGBA8888) stays
+    void darken_row(uint32_t* row, unsigned int count){
+        unsigned int x = 0;
+#if defined(__SSE2__)
+        const __m128i colorMask = _mm_set1_epi32(0x7F7F7F00);
+        const __m128i alphaMask = _mm_set1_epi32(0xFF);
+        for (; x + 4 <= count; x += 4){
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            __m128i darker = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 1), colorMask), _mm_and_si128(pixels, alphaMask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), darker);
+        }
+#endif
+        for (; x < count; x++)
+            row[x] = ((row[x] >> 1) & 0x7F7F7F00u) | (row[x] & 0xFFu);
+    }
+
+}
+
+void scale_nearest(const uint32_t* src, unsigned int width, unsigned int height, unsigned int factor, uint32_t* dst){
+    //rows are widened once and the copies below are plain memcpys
+    size_t rowPixels = (size_t)width * factor;
+    for (unsigned int y = 0; y < height; y++){
+        uint32_t* first = dst + (size_t)y * factor * rowPixels;
+        widen_row(src + (size_t)y * width, width, factor, first);
+        for (unsigned int i = 1; i < factor; i++)
+            std::memcpy(first + i * rowPixels, first, rowPixels * sizeof(uint32_t));
+    }
+}
+
+void scale_scanlines(const uint32_t* src, unsigned int width, unsigned int height, unsigned int factor, uint32_t* dst){
+    scale_nearest(src, width, height, factor, dst);
+    if (factor < 2)
+        return;
+    size_t rowPixels = (size_t)width * factor;
+    for (unsigned int y = 0; y < height; y++)
+        darken_row(dst + ((size_t)y * factor + factor - 1) * rowPixels, (unsigned int)rowPixels);
+}
+
+void scale_epx(const uint32_t* src, unsigned int width, unsigned int height, uint32_t* dst){
+    //   A        E0 E1
+    // C P B  ->  E2 E3
+    //   D
+    //E0 = A if C == A, C != D and A != B, otherwise P (and the same rotated for E1, E2, E3),
+    //pixels past the edges repeat the edge
+    std::vector<uint32_t> padded(3 * (width + 2));
+    uint32_t* above = padded.data();
+    uint32_t* center = above + width + 2;
+    uint32_t* below = center + width + 2;
+    auto load = [&](uint32_t* row, unsigned int y){
+        std::memcpy(row + 1, src + (size_t)y * width, width * sizeof(uint32_t));
+        row[0] = row[1];
+        row[width + 1] = row[width];
+    };
+
+    for (unsigned int y = 0; y < height; y++){
+        load(above, y > 0 ? y - 1 : 0);
+        load(center, y);
+        load(below, y + 1 < height ? y + 1 : y);
+        uint32_t* top = dst + (size_t)2 * y * 2 * width;
+        uint32_t* bottom = top + 2 * width;
+
+        unsigned int x = 0;
+#if defined(__SSE2__)
+        for (; x + 4 <= width; x += 4){
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x + 1));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x + 1));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x));
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x + 1));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x + 2));
+            __m128i ca = _mm_cmpeq_epi32(c, a), cd = _mm_cmpeq_epi32(c, d);
+            __m128i ab = _mm_cmpeq_epi32(a, b), bd = _mm_cmpeq_epi32(b, d);
+            //e = condition ? corner : p
+            __m128i m0 = _mm_andnot_si128(_mm_or_si128(cd, ab), ca);
+            __m128i m1 = _mm_andnot_si128(_mm_or_si128(ca, bd), ab);
+            __m128i m2 = _mm_andnot_si128(_mm_or_si128(bd, ca), cd);
+            __m128i m3 = _mm_andnot_si128(_mm_or_si128(ab, cd), bd);
+            __m128i e0 = _mm_or_si128(_mm_and_si128(m0, a), _mm_andnot_si128(m0, p));
+            __m128i e1 = _mm_or_si128(_mm_and_si128(m1, b), _mm_andnot_si128(m1, p));
+            __m128i e2 = _mm_or_si128(_mm_and_si128(m2, c), _mm_andnot_si128(m2, p));
+            __m128i e3 = _mm_or_si128(_mm_and_si128(m3, d), _mm_andnot_si128(m3, p));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(top + 2 * x), _mm_unpacklo_epi32(e0, e1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(top + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bottom + 2 * x), _mm_unpacklo_epi32(e2, e3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bottom + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+        }
+#endif
+        for (; x < width; x++){
+            uint32_t a = above[x + 1], d = below[x + 1], c = center[x], p = center[x + 1], b = center[x + 2];
+            top[2 * x] = (c == a && c != d && a != b) ? a : p;
+            top[2 * x + 1] = (a == b && a != c && b != d) ? b : p;
+            bottom[2 * x] = (d == c && d != b && c != a) ? c : p;
+            bottom[2 * x + 1] = (b == d && b != a && d != c) ? d : p;
+        }
+    }
+}